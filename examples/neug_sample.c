@@ -29,5 +29,50 @@ void generate_random()
 
 MSH_CMD_EXPORT(generate_random, generate random);
 
+#if defined(PKG_USING_NEUG_DEVICE) && defined(RT_USING_POSIX_DEVIO)
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+/* Read /dev/hwrng without blocking, as POSIX code does.  */
+void read_random_dev()
+{
+  uint8_t buf[RANDOM_BYTES_LENGTH];
+  struct pollfd pfd;
+  int n = 0, r, i;
+
+  pfd.fd = open("/dev/hwrng", O_RDONLY | O_NONBLOCK);
+  if (pfd.fd < 0)
+  {
+    rt_kprintf("can't open /dev/hwrng\n");
+    return;
+  }
+
+  pfd.events = POLLIN;
+  while (n < RANDOM_BYTES_LENGTH)
+  {
+    if (poll(&pfd, 1, -1) < 0)
+    {
+      break;
+    }
+
+    r = read(pfd.fd, buf + n, RANDOM_BYTES_LENGTH - n);
+    if (r > 0)
+    {
+      n += r;
+    }
+  }
+
+  close(pfd.fd);
+  for(i=0;i<n;i++)
+  {
+    rt_kprintf("%02x",buf[i]);
+  }
+  rt_kprintf("\n");
+}
+
+MSH_CMD_EXPORT(read_random_dev, read /dev/hwrng with poll);
+#endif
+
 #endif
 
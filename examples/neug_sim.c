@@ -0,0 +1,191 @@
+/*
+ * neug_sim.c - measure the cost of the health tests, with simulated
+ *              noise source (ports/adc-sim.c).
+ *
+ * For each profile, it drains the output for some seconds and reports
+ * the throughput, the rate of discarded output, the errors of the
+ * tests, and the distribution (min/median/max) of the maximum counts
+ * of the tests (neug_rc_max, neug_p64_max and neug_p4k_max) for each
+ * 100 ms.  It uses NeuG started by random_init (on the simulated
+ * noise source), and disables the refill of the random byte slots
+ * during the runs, so that it sees all the output.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rtthread.h>
+
+#include "neug.h"
+#include "random.h"
+#include "adc-sim.h"
+
+#define SIM_INTERVAL    (RT_TICK_PER_SECOND / 10)
+#define SIM_POINTS_MAX  600
+
+static uint16_t sim_rc[SIM_POINTS_MAX];
+static uint16_t sim_p64[SIM_POINTS_MAX];
+static uint16_t sim_p4k[SIM_POINTS_MAX];
+
+/* Default parameters of the profiles, for "all".  */
+static const uint32_t sim_default[ADC_SIM_PROFILE_NUM][2] = {
+  { 0, 0 },			/* ideal */
+  { 500, 0 },			/* biased: a half is zero */
+  { 0, 0 },			/* stuck from the start */
+  { 900, 0 },			/* correlated: 90% repeat */
+  { 100000, 1024 },		/* burst: 1024 of 100000 samples */
+};
+
+static int sim_cmp (const void *a, const void *b)
+{
+  return *(const uint16_t *)a - *(const uint16_t *)b;
+}
+
+static void sim_print_dist (uint16_t *v, int n)
+{
+  qsort (v, n, sizeof (uint16_t), sim_cmp);
+  rt_kprintf (" %3d/%3d/%3d", v[0], v[n / 2], v[n - 1]);
+}
+
+static void sim_run (int profile, uint32_t p1, uint32_t p2, int seconds)
+{
+  rt_tick_t start, next;
+  rt_tick_t duration = seconds * RT_TICK_PER_SECOND;
+  uint32_t words = 0, out = 0, discard = 0;
+  uint32_t err_rc = 0, err_p64 = 0, err_p4k = 0;
+  uint32_t permille;
+  int points = 0;
+
+  adc_sim_set_profile (profile, p1, p2);
+  neug_flush ();
+  neug_stat_reset ();
+
+  start = next = rt_tick_get ();
+  while (rt_tick_get () - start < duration)
+  {
+    struct neug_span span;
+    int n = neug_peek (&span);
+
+    if (n)
+    {
+      neug_commit (n);
+      words += n;
+    }
+    else
+    {
+      /* Wait for the generator, the ring of random_init is small.  */
+      (void)neug_get (NEUG_KICK_FILLING);
+      words++;
+    }
+
+    if (rt_tick_get () - next >= SIM_INTERVAL && points < SIM_POINTS_MAX)
+    {
+      sim_rc[points] = neug_rc_max;
+      sim_p64[points] = neug_p64_max;
+      sim_p4k[points] = neug_p4k_max;
+      points++;
+
+      out += neug_out_cnt;
+      discard += neug_discard_cnt;
+      err_rc += neug_err_cnt_rc;
+      err_p64 += neug_err_cnt_p64;
+      err_p4k += neug_err_cnt_p4k;
+      neug_stat_reset ();
+      next += SIM_INTERVAL;
+    }
+  }
+
+  out += neug_out_cnt;
+  discard += neug_discard_cnt;
+  permille = out + discard ? (uint64_t)discard * 10000 / (out + discard) : 0;
+
+  rt_kprintf ("%-10s %6u %5u %9u %3u.%u%% %5u/%5u/%5u",
+              adc_sim_profile_name (profile), p1, p2, words / seconds,
+              permille / 100, (permille / 10) % 10, err_rc, err_p64, err_p4k);
+  if (points)
+  {
+    sim_print_dist (sim_rc, points);
+    sim_print_dist (sim_p64, points);
+    sim_print_dist (sim_p4k, points);
+  }
+  rt_kprintf ("\n");
+}
+
+/*
+ * neug_sim [all|PROFILE [P1 [P2]]] [-t SECONDS]
+ */
+int neug_sim (int argc, char **argv)
+{
+  int profile = -1;
+  uint32_t p1 = 0, p2 = 0;
+  int seconds = 3;
+  int i, n = 0;
+
+  for (i = 1; i < argc; i++)
+  {
+    if (!strcmp (argv[i], "-t") && i + 1 < argc)
+    {
+      seconds = atoi (argv[++i]);
+    }
+    else if (n == 0)
+    {
+      n++;
+      if (strcmp (argv[i], "all"))
+      {
+        profile = adc_sim_profile_find (argv[i]);
+        if (profile < 0)
+        {
+          rt_kprintf ("neug_sim: unknown profile %s\n", argv[i]);
+          return -1;
+        }
+      }
+    }
+    else if (n++ == 1)
+    {
+      p1 = strtoul (argv[i], NULL, 0);
+    }
+    else
+    {
+      p2 = strtoul (argv[i], NULL, 0);
+    }
+  }
+
+  if (seconds <= 0)
+  {
+    seconds = 1;
+  }
+
+  if (!neug_is_started ())
+  {
+    rt_kprintf ("neug_sim: NeuG is not started\n");
+    return -1;
+  }
+
+  neug_wait_ready (RT_WAITING_FOREVER);
+  random_refill_enable (0);
+
+  rt_kprintf ("profile        p1    p2   words/s discard  errors rc/p64/p4k"
+              "  rc_max p64_max p4k_max (min/med/max)\n");
+
+  if (profile >= 0)
+  {
+    sim_run (profile, p1, p2, seconds);
+  }
+  else
+  {
+    for (i = 0; i < ADC_SIM_PROFILE_NUM; i++)
+    {
+      sim_run (i, sim_default[i][0], sim_default[i][1], seconds);
+    }
+  }
+
+  adc_sim_set_profile (ADC_SIM_IDEAL, 0, 0);
+  random_refill_enable (1);
+  return 0;
+}
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+
+MSH_CMD_EXPORT(neug_sim, measure health tests: neug_sim [all|profile [p1 [p2]]] [-t sec]);
+#endif
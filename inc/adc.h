@@ -1,7 +1,23 @@
 #ifndef  __ADC_H__
 #define  __ADC_H__
 
-extern uint32_t adc_buf[64];
+/*
+ * Samples of a conversion at most.  When it's N (140 for SHA-256) or
+ * more, a conversion has all samples for one output or more.
+ */
+#ifndef NEUG_ADC_BUF_SIZE
+#define NEUG_ADC_BUF_SIZE 64
+#endif
+
+/*
+ * Bits of a sample which have the noise (the low bits), declared by
+ * the port: 1, 2, 4, 8, 16 or 32.  Only these bits go to the filter.
+ */
+#ifndef NEUG_ADC_NOISE_BITS
+#define NEUG_ADC_NOISE_BITS 32
+#endif
+
+extern uint32_t adc_buf[NEUG_ADC_BUF_SIZE];
 
 int adc_init (void);
 void adc_start (void);
@@ -0,0 +1,20 @@
+#ifndef  __BLAKE2S_H__
+#define  __BLAKE2S_H__
+
+#define BLAKE2S_DIGEST_SIZE 32
+#define BLAKE2S_BLOCK_SIZE  64
+
+typedef struct {
+  uint32_t h[8];
+  uint32_t t[2];
+  uint8_t buffer[BLAKE2S_BLOCK_SIZE];
+  uint8_t buflen;
+} blake2s_context;
+
+void blake2s_start (blake2s_context *ctx);
+void blake2s_update (blake2s_context *ctx, const uint8_t *input,
+		     unsigned int ilen);
+void blake2s_finish (blake2s_context *ctx,
+		     uint8_t output[BLAKE2S_DIGEST_SIZE]);
+
+#endif
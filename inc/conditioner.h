@@ -0,0 +1,64 @@
+#ifndef  __CONDITIONER_H__
+#define  __CONDITIONER_H__
+
+#include "tiny_sha2.h"
+#if defined(PKG_USING_NEUG_SHA512) || defined(PKG_NEUG_CONDITIONER_SHA512)
+#include "sha512.h"
+#endif
+#if defined(PKG_USING_NEUG_BLAKE2S) || defined(PKG_NEUG_CONDITIONER_BLAKE2S)
+#include "blake2s.h"
+#endif
+
+/* Largest block size, digest size and N of conditioners.  */
+#if defined(PKG_USING_NEUG_SHA512) || defined(PKG_NEUG_CONDITIONER_SHA512)
+#define NEUG_COND_BLOCK_MAX  128
+#define NEUG_COND_DIGEST_MAX 64
+#define NEUG_COND_NOISE_INPUTS_MAX 280
+#else
+#define NEUG_COND_BLOCK_MAX  64
+#define NEUG_COND_DIGEST_MAX 32
+#define NEUG_COND_NOISE_INPUTS_MAX 140
+#endif
+#define NEUG_COND_NOISE_INPUTS_MIN 140
+
+union neug_cond_ctx {
+  tiny_sha2_context sha256;
+#if defined(PKG_USING_NEUG_SHA512) || defined(PKG_NEUG_CONDITIONER_SHA512)
+  sha512_context sha512;
+#endif
+#if defined(PKG_USING_NEUG_BLAKE2S) || defined(PKG_NEUG_CONDITIONER_BLAKE2S)
+  blake2s_context blake2s;
+#endif
+};
+
+/*
+ * Conditioning component, used as the hash function of hash_df.
+ *
+ * NOISE_INPUTS is the number of samples for an output of
+ * DIGEST_SIZE, see the comment of ep_process in neug.c.  It must be
+ * a multiple of 4.
+ */
+struct neug_conditioner {
+  const char *name;
+  uint16_t block_size;
+  uint16_t digest_size;
+  uint16_t noise_inputs;
+  void (*starts) (union neug_cond_ctx *ctx);
+  void (*update) (union neug_cond_ctx *ctx, const uint8_t *input, int ilen);
+  void (*finish) (union neug_cond_ctx *ctx, uint8_t *output);
+};
+
+extern const struct neug_conditioner neug_cond_sha256;
+#if defined(PKG_USING_NEUG_SHA512) || defined(PKG_NEUG_CONDITIONER_SHA512)
+extern const struct neug_conditioner neug_cond_sha512;
+#endif
+#if defined(PKG_USING_NEUG_BLAKE2S) || defined(PKG_NEUG_CONDITIONER_BLAKE2S)
+extern const struct neug_conditioner neug_cond_blake2s;
+#endif
+
+extern const struct neug_conditioner *const neug_cond_default;
+
+const struct neug_conditioner *neug_conditioner_find (const char *name);
+int neug_conditioner_selftest (const struct neug_conditioner *cond);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef  __DRBG_H__
+#define  __DRBG_H__
+
+/* Hash_DRBG of SHA-256, security strength 256-bit.  */
+#define DRBG_SEEDLEN         55	/* 440-bit */
+#define DRBG_MAX_REQUEST  65536	/* 2^19-bit */
+
+typedef struct {
+  uint8_t v[DRBG_SEEDLEN];
+  uint8_t c[DRBG_SEEDLEN];
+  uint32_t reseed_counter;
+} drbg_context;
+
+void drbg_instantiate (drbg_context *ctx, const uint8_t *entropy, int elen,
+		       const uint8_t *pers, int plen);
+void drbg_reseed (drbg_context *ctx, const uint8_t *entropy, int elen);
+void drbg_generate (drbg_context *ctx, uint8_t *output, int len);
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef  __NEUG_DEV_H__
+#define  __NEUG_DEV_H__
+
+/*
+ * NeuG as RT-Thread character devices, "hwrng" and "urandom".  They
+ * are registered at INIT_ENV_EXPORT, after random_init.
+ */
+int neug_dev_register (void);
+void neug_dev_unregister (void);
+
+#endif
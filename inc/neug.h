@@ -1,32 +1,117 @@
 #ifndef  __NEUG_H__
 #define  __NEUG_H__
 
+/* Set up for C function definitions, even when using C++ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define NEUG_NO_KICK      0
 #define NEUG_KICK_FILLING 1
 
 #define NEUG_PRE_LOOP 32
 
+/* Class of consumers, higher class is served first.  */
+#define NEUG_PRIO_BULK    0	/* Bulk, background jobs.           */
+#define NEUG_PRIO_NORMAL  1	/* Default.                         */
+#define NEUG_PRIO_URGENT  2	/* Latency critical, can use reserve. */
+#define NEUG_PRIO_NUM     3
+
+/* Class of random for neug_read.  */
+#define NEUG_CLASS_FULL_ENTROPY 0 /* Conditioned data, full entropy. */
+#define NEUG_CLASS_DRBG_PR      1 /* DRBG, reseeded for each request. */
+#define NEUG_CLASS_DRBG         2 /* DRBG, never waits for the source. */
+
 #define NEUG_MODE_CONDITIONED 0	/* Conditioned data.             */
 #define NEUG_MODE_RAW         1	/* CRC-32 filtered sample data.  */
 #define NEUG_MODE_RAW_DATA    2	/* Sample data directly.         */
 
+/* Occupancy and counters of a shard of the ring buffer.  */
+struct neug_shard_info {
+  uint16_t count;
+  uint16_t size;
+  uint32_t added;
+  uint32_t taken;
+  uint32_t stolen;
+};
+
+/* Duty cycling of the ADC, by neug_duty_info.  */
+struct neug_duty_info {
+  uint32_t stops;		/* Times the ADC was stopped      */
+  uint32_t off_ticks;		/* Ticks with the ADC stopped     */
+  uint32_t idle_ticks;		/* Full ring buffer before a stop */
+  uint32_t latency_last;	/* Ticks from a restart to data   */
+  uint32_t latency_max;
+  int stopped;
+};
+
+/* Raw tap, by neug_tap_info.  */
+struct neug_tap_info {
+  uint32_t copied;		/* Samples copied into the tap   */
+  uint32_t dropped;		/* Samples dropped, as it's full */
+  int count;			/* Samples in the tap            */
+  int size;
+  int every;			/* One conversion of EVERY       */
+  int running;
+};
+
+/* Words peeked by neug_peek, up to two regions.  */
+struct neug_span {
+  const uint32_t *p[2];
+  int n[2];
+};
+
 extern uint8_t neug_mode;
 extern uint16_t neug_err_cnt;
 extern uint16_t neug_err_cnt_rc;
 extern uint16_t neug_err_cnt_p64;
 extern uint16_t neug_err_cnt_p4k;
+#ifdef PKG_USING_NEUG_OUTPUT_MONITOR
+extern uint16_t neug_err_cnt_stuck;
+extern uint16_t neug_err_cnt_stat;
+#endif
 extern uint16_t neug_rc_max;
 extern uint16_t neug_p64_max;
 extern uint16_t neug_p4k_max;
+extern uint32_t neug_out_cnt;
+extern uint32_t neug_discard_cnt;
 
 void crc32_rv_reset (void);
 void crc32_rv_step (uint32_t v);
 uint32_t crc32_rv_get (void);
 void crc32_rv_stop (void);
 
-void neug_init (uint32_t *buf, uint8_t size);
+void neug_stat_reset (void);
+
+int neug_conditioner_select (const char *name);
+int neug_init (uint32_t *buf, uint8_t size);
+int neug_is_started (void);
+int neug_is_ready (void);
+int neug_wait_ready (int32_t timeout);
 uint32_t neug_get (int kick);
+uint32_t neug_get_prio (int kick, int prio);
 int neug_get_nonblock (uint32_t *p);
+int neug_get_nonblock_prio (uint32_t *p, int prio);
+int neug_peek (struct neug_span *span);
+int neug_commit (int n);
+void neug_get_words (uint32_t *p, int n);
+uint32_t neug_entropy_avail (void);
+int neug_words_avail (void);
+int neug_shard_info (int i, struct neug_shard_info *info);
+void neug_duty_info (struct neug_duty_info *info);
+int neug_tap_start (uint32_t *buf, int size, int every);
+void neug_tap_stop (void);
+int neug_tap_read (uint32_t *p, int n, int32_t timeout);
+void neug_tap_info (struct neug_tap_info *info);
+void neug_set_notify (void (*proc) (void));
+int neug_read (int cls, void *buf, int len);
+int neug_drbg_try_seed (void);
+
+uint32_t neug_uniform_u32 (uint32_t bound);
+uint64_t neug_uniform_u64 (uint64_t bound);
+void neug_fill_uniform (uint32_t *a, int n, uint32_t bound);
+void neug_fill_double (double *a, int n);
+
 void neug_kick_filling (void);
 
 void neug_wait_full (void);
@@ -35,6 +120,12 @@ void neug_flush (void);
 void neug_mode_select (uint8_t mode);
 int neug_consume_random (void (*proc) (uint32_t, int));
 
+int neug_seed_save (void);
 void neug_fini (void);
 
+/* Ends C function definitions when using C++ */
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,190 @@
+#ifndef  __NEUG_HPP__
+#define  __NEUG_HPP__
+
+/*
+ * C++ interface of NeuG, header only.  It needs C++17, and the fill
+ * functions on std::span need C++20.
+ *
+ *   neug::generator    handle of NeuG, started by random_init.
+ *   neug::fill ()      fills words or bytes, taking many words at once.
+ *   neug::engine       UniformRandomBitGenerator for <random>, which
+ *   neug::engine64     refills its own buffer in bulk.
+ */
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#if __cplusplus >= 202002L
+#include <span>
+#endif
+
+#include <rtthread.h>
+#include "neug.h"
+
+namespace neug
+{
+  /*
+   * Handle of NeuG, which is started once at boot by random_init.  It
+   * doesn't own NeuG: it neither initializes nor stops it, so that C
+   * callers and the random byte slots keep working.  Any number of
+   * them can be made.
+   */
+  class generator
+  {
+  public:
+    generator ()
+    {
+      ok_ = neug_is_started () != 0;
+    }
+
+    /* False when NeuG is not running.  */
+    bool ok () const
+    {
+      return ok_;
+    }
+
+    /* Wait for the warm-up, at most TIMEOUT ticks.  */
+    bool wait_ready (std::int32_t timeout = RT_WAITING_FOREVER)
+    {
+      return neug_wait_ready (timeout) == 0;
+    }
+
+  private:
+    bool ok_;
+  };
+
+  /*
+   * Fill N words.  Words ready in the ring buffer are copied at once,
+   * it only waits word by word when it's empty.
+   */
+  inline void fill (std::uint32_t *p, std::size_t n)
+  {
+    neug_get_words (p, static_cast<int> (n));
+  }
+
+  /* Clear memory which had random data, not optimized away.  */
+  inline void wipe (void *p, std::size_t n)
+  {
+    volatile unsigned char *q = static_cast<volatile unsigned char *> (p);
+
+    while (n--)
+    {
+      *q++ = 0;
+    }
+  }
+
+  /* Fill N bytes.  */
+  inline void fill_bytes (void *p, std::size_t n)
+  {
+    unsigned char *d = static_cast<unsigned char *> (p);
+    std::uint32_t tmp[16];
+
+    while (n > 0)
+    {
+      std::size_t m = n < sizeof tmp ? n : sizeof tmp;
+
+      fill (tmp, (m + 3) / 4);
+      std::memcpy (d, tmp, m);
+      d += m;
+      n -= m;
+    }
+
+    wipe (tmp, sizeof tmp);
+  }
+
+#if __cplusplus >= 202002L
+  inline void fill (std::span<std::uint32_t> s)
+  {
+    fill (s.data (), s.size ());
+  }
+
+  inline void fill (std::span<std::byte> s)
+  {
+    fill_bytes (s.data (), s.size ());
+  }
+
+  /* By neug_read, of class CLS (NEUG_CLASS_*).  Return false on error.  */
+  inline bool read (int cls, std::span<std::byte> s)
+  {
+    return neug_read (cls, s.data (), static_cast<int> (s.size ()))
+      == static_cast<int> (s.size ());
+  }
+#endif
+
+  /*
+   * UniformRandomBitGenerator of UINTTYPE (32-bit or 64-bit), which
+   * takes WORDS words at once into its buffer.  It can't be copied, so
+   * that the same numbers are never used twice; the buffer is cleared
+   * when destroyed.
+   */
+  template <class UIntType = std::uint32_t, std::size_t Words = 32>
+  class basic_engine
+  {
+    static_assert (std::is_same<UIntType, std::uint32_t>::value
+                   || std::is_same<UIntType, std::uint64_t>::value,
+                   "result_type must be std::uint32_t or std::uint64_t");
+    static_assert (Words >= 2 && Words % 2 == 0,
+                   "Words must be even");
+
+  public:
+    using result_type = UIntType;
+
+    basic_engine () = default;
+    basic_engine (const basic_engine &) = delete;
+    basic_engine &operator= (const basic_engine &) = delete;
+
+    ~basic_engine ()
+    {
+      wipe (buf_, sizeof buf_);
+    }
+
+    static constexpr result_type min ()
+    {
+      return 0;
+    }
+
+    static constexpr result_type max ()
+    {
+      return std::numeric_limits<result_type>::max ();
+    }
+
+    result_type operator() ()
+    {
+      if (pos_ == Words)
+      {
+        fill (buf_, Words);
+        pos_ = 0;
+      }
+
+      if constexpr (sizeof (result_type) == sizeof (std::uint32_t))
+      {
+        return buf_[pos_++];
+      }
+      else
+      {
+        result_type v = buf_[pos_]
+          | (static_cast<result_type> (buf_[pos_ + 1]) << 32);
+
+        pos_ += 2;
+        return v;
+      }
+    }
+
+    /* Drop the buffered words.  */
+    void discard_buffer ()
+    {
+      wipe (buf_, sizeof buf_);
+      pos_ = Words;
+    }
+
+  private:
+    std::uint32_t buf_[Words] = {};
+    std::size_t pos_ = Words;
+  };
+
+  using engine = basic_engine<std::uint32_t>;
+  using engine64 = basic_engine<std::uint64_t>;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef  __NEUG_TRACE_H__
+#define  __NEUG_TRACE_H__
+
+/* Events of the generator and consumers.  */
+#define NEUG_TRACE_ADC          0 /* Wait for ADC conversion.    */
+#define NEUG_TRACE_FILTER       1 /* CRC-32 filter and tests.    */
+#define NEUG_TRACE_CONDITION    2 /* Hash function of hash_df.   */
+#define NEUG_TRACE_PUBLISH      3 /* Add the output to the ring. */
+#define NEUG_TRACE_RING_FULL    4 /* Wait for space in the ring. */
+#define NEUG_TRACE_MODE         5 /* Mode switch (instant).      */
+#define NEUG_TRACE_DISCARD      6 /* Health test error (instant).*/
+#define NEUG_TRACE_CONSUMER     7 /* Consumer waits for data.    */
+#define NEUG_TRACE_EVENT_NUM    8
+
+#ifdef PKG_USING_NEUG_TRACE
+void neug_trace_event (int ev, char ph);
+void neug_trace_poll (void);
+int neug_trace_dump (const char *path);
+void neug_trace_reset (void);
+int neug_trace_install_signal (void);
+/* By the port, with NEUG_TRACE_CLOCK_PORT.  */
+uint32_t neug_trace_clock (void);
+
+#define NEUG_TRACE_BEGIN(ev)   neug_trace_event (ev, 'B')
+#define NEUG_TRACE_END(ev)     neug_trace_event (ev, 'E')
+#define NEUG_TRACE_INSTANT(ev) neug_trace_event (ev, 'i')
+#define NEUG_TRACE_POLL()      neug_trace_poll ()
+#else
+#define NEUG_TRACE_BEGIN(ev)
+#define NEUG_TRACE_END(ev)
+#define NEUG_TRACE_INSTANT(ev)
+#define NEUG_TRACE_POLL()
+#endif
+
+#endif
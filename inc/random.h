@@ -10,6 +10,8 @@ extern "C" {
 #endif
 
 int random_init (void);
+int random_is_ready (void);
+int random_wait_ready (int32_t timeout);
 
 /* 32-byte random bytes */
 const uint8_t * random_bytes_get (void);
@@ -20,6 +22,8 @@ void random_get_salt (uint8_t *p);
 
 int random_gen (void *arg, unsigned char *out, size_t out_len);
 
+void random_refill_enable (int on);
+
 void random_fini (void);
 
 /* Ends C function definitions when using C++ */
@@ -0,0 +1,14 @@
+#ifndef  __SEED_H__
+#define  __SEED_H__
+
+/*
+ * Storage of the seed, kept across restart.  The default one is a
+ * file (NEUG_SEED_FILE), a port can define NEUG_SEED_PORT and
+ * implement these for a flash region.
+ */
+#define NEUG_SEED_SIZE 32
+
+int neug_seed_read (uint8_t *seed);
+int neug_seed_write (const uint8_t *seed);
+
+#endif
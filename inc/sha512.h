@@ -0,0 +1,18 @@
+#ifndef  __SHA512_H__
+#define  __SHA512_H__
+
+#define SHA512_DIGEST_SIZE 64
+#define SHA512_BLOCK_SIZE  128
+
+typedef struct {
+  uint64_t total;
+  uint64_t state[8];
+  uint8_t buffer[SHA512_BLOCK_SIZE];
+} sha512_context;
+
+void sha512_start (sha512_context *ctx);
+void sha512_update (sha512_context *ctx, const uint8_t *input,
+		    unsigned int ilen);
+void sha512_finish (sha512_context *ctx, uint8_t output[SHA512_DIGEST_SIZE]);
+
+#endif
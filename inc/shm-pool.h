@@ -0,0 +1,20 @@
+#ifndef  __SHM_POOL_H__
+#define  __SHM_POOL_H__
+
+/*
+ * Output pool in POSIX shared memory, on GNU/Linux.  A producer
+ * process, which runs NeuG, publishes blocks of NEUG_SHM_BLOCK words,
+ * and consumer processes, which don't run NeuG, take them.
+ */
+struct neug_shm;
+
+/* Producer side, after neug_init.  */
+int neug_shm_publish (const char *name);
+void neug_shm_unpublish (void);
+
+/* Consumer side.  */
+struct neug_shm *neug_shm_open (const char *name);
+int neug_shm_read (struct neug_shm *shm, void *buf, int len, int32_t timeout);
+void neug_shm_close (struct neug_shm *shm);
+
+#endif
@@ -31,11 +31,13 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <rtthread.h>
+
 #include "adc.h"
 
 #define ADC_RANDOM_SEED 0x01034649 /* "Hello, father!" in Japanese */
 
-uint32_t adc_buf[64];
+uint32_t adc_buf[NEUG_ADC_BUF_SIZE];
 
 /*
  * Do calibration for ADC.
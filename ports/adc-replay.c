@@ -0,0 +1,287 @@
+/*
+ * adc-replay.c - ADC driver for reproducible runs.
+ *                This ADC driver fills samples from a recorded
+ *                capture file, or from a seeded counter-based
+ *                generator.  It's useful for benchmarking and for
+ *                comparing the output of NeuG between builds.
+ *
+ * This file is a part of NeuG, a True Random Number Generator
+ * implementation based on quantization error of ADC (for STM32F103).
+ *
+ * NeuG is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NeuG is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rtthread.h>
+
+#if defined(__linux__)
+#include <time.h>
+#endif
+
+#include "adc.h"
+#include "adc-replay.h"
+
+/*
+ * The capture file is a sequence of samples, each as 32-bit little
+ * endian word.  It is read by chunk, and it wraps around at the end.
+ */
+#ifndef NEUG_REPLAY_FILE
+#define NEUG_REPLAY_FILE RT_NULL
+#endif
+
+#ifndef NEUG_REPLAY_SEED
+#define NEUG_REPLAY_SEED 0x01034649
+#endif
+
+/* Samples per second, 0 for no limit.  */
+#ifndef NEUG_REPLAY_SAMPLE_RATE
+#define NEUG_REPLAY_SAMPLE_RATE 0
+#endif
+
+/* Extra latency of a conversion, in microseconds.  */
+#ifndef NEUG_REPLAY_LATENCY_US
+#define NEUG_REPLAY_LATENCY_US 0
+#endif
+
+#define REPLAY_CHUNK 1024
+
+uint32_t adc_buf[NEUG_ADC_BUF_SIZE];
+
+static const char *replay_path = NEUG_REPLAY_FILE;
+static FILE *replay_fp;
+static uint32_t replay_chunk[REPLAY_CHUNK];
+static int replay_chunk_len;
+static int replay_chunk_pos;
+
+static uint32_t replay_seed = NEUG_REPLAY_SEED;
+static uint32_t replay_count;
+
+static uint32_t replay_rate = NEUG_REPLAY_SAMPLE_RATE;
+static uint32_t replay_latency = NEUG_REPLAY_LATENCY_US;
+static uint64_t replay_deadline;	/* in microseconds */
+
+int adc_replay_set_file (const char *path)
+{
+  replay_path = path;
+  return 0;
+}
+
+void adc_replay_set_seed (uint32_t seed)
+{
+  replay_seed = seed;
+}
+
+void adc_replay_set_timing (uint32_t sample_rate, uint32_t latency_us)
+{
+  replay_rate = sample_rate;
+  replay_latency = latency_us;
+}
+
+/*
+ * Return the number of samples delivered since adc_init.
+ */
+uint32_t adc_replay_samples (void)
+{
+  return replay_count;
+}
+
+static uint64_t replay_now (void)
+{
+#if defined(__linux__)
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+  return (uint64_t)rt_tick_get () * 1000000 / RT_TICK_PER_SECOND;
+#endif
+}
+
+static void replay_sleep_until (uint64_t t)
+{
+  uint64_t now = replay_now ();
+
+  if (t <= now)
+  {
+    return;
+  }
+
+#if defined(__linux__)
+  {
+    struct timespec ts;
+
+    ts.tv_sec = (t - now) / 1000000;
+    ts.tv_nsec = ((t - now) % 1000000) * 1000;
+    nanosleep (&ts, NULL);
+  }
+#else
+  rt_thread_delay ((rt_tick_t)((t - now) * RT_TICK_PER_SECOND / 1000000));
+#endif
+}
+
+/*
+ * Counter based generator: sample i is a function of (seed, i) only,
+ * so that the stream doesn't depend on anything else in the process.
+ * This is the finalizer of MurmurHash3.
+ */
+static uint32_t replay_gen (uint32_t i)
+{
+  uint32_t v = i * 0x9e3779b9 + replay_seed;
+
+  v ^= v >> 16;
+  v *= 0x85ebca6b;
+  v ^= v >> 13;
+  v *= 0xc2b2ae35;
+  v ^= v >> 16;
+  return v;
+}
+
+static int replay_fill_chunk (void)
+{
+  size_t n;
+
+  n = fread (replay_chunk, sizeof (uint32_t), REPLAY_CHUNK, replay_fp);
+  if (n == 0)
+  {
+    rewind (replay_fp);
+    n = fread (replay_chunk, sizeof (uint32_t), REPLAY_CHUNK, replay_fp);
+    if (n == 0)
+    {
+      return -1;
+    }
+  }
+
+  replay_chunk_len = n;
+  replay_chunk_pos = 0;
+  return 0;
+}
+
+/*
+ * Open the capture file, if any.
+ */
+int adc_init (void)
+{
+  replay_count = 0;
+  replay_chunk_len = replay_chunk_pos = 0;
+
+  if (replay_fp)
+  {
+    fclose (replay_fp);
+    replay_fp = NULL;
+  }
+
+  if (replay_path)
+  {
+    replay_fp = fopen (replay_path, "rb");
+    if (replay_fp == NULL)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+void adc_start (void)
+{
+  replay_deadline = replay_now ();
+}
+
+void adc_start_conversion (int offset, int count)
+{
+  uint64_t now = replay_now ();
+
+  /* The conversion starts now, or when the previous one finishes.  */
+  if (replay_deadline < now)
+  {
+    replay_deadline = now;
+  }
+
+  if (replay_rate)
+  {
+    replay_deadline += (uint64_t)count * 1000000 / replay_rate;
+  }
+
+  replay_deadline += replay_latency;
+
+  if (replay_fp)
+  {
+    while (count)
+    {
+      int n;
+
+      if (replay_chunk_pos == replay_chunk_len && replay_fill_chunk () < 0)
+      {
+        memset (&adc_buf[offset], 0, count * sizeof (uint32_t));
+        break;
+      }
+
+      n = replay_chunk_len - replay_chunk_pos;
+      if (n > count)
+      {
+        n = count;
+      }
+
+      memcpy (&adc_buf[offset], &replay_chunk[replay_chunk_pos],
+              n * sizeof (uint32_t));
+      replay_chunk_pos += n;
+      replay_count += n;
+      offset += n;
+      count -= n;
+    }
+  }
+  else
+  {
+    while (count--)
+    {
+      adc_buf[offset++] = replay_gen (replay_count++);
+    }
+  }
+}
+
+/*
+ * Return 0 on success.
+ * Return 1 on error.
+ */
+int adc_wait_completion (void)
+{
+  if (replay_rate || replay_latency)
+  {
+    replay_sleep_until (replay_deadline);
+  }
+
+  return 0;
+}
+
+/*
+ * The capture file is kept open, so that adc_start after this (by
+ * PKG_USING_NEUG_ADC_DUTY_CYCLE) continues the same stream.  It's
+ * closed by adc_replay_close, or by adc_init for the next run.
+ */
+void adc_stop (void)
+{
+}
+
+void adc_replay_close (void)
+{
+  if (replay_fp)
+  {
+    fclose (replay_fp);
+    replay_fp = NULL;
+  }
+}
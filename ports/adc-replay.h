@@ -0,0 +1,16 @@
+#ifndef  __ADC_REPLAY_H__
+#define  __ADC_REPLAY_H__
+
+/*
+ * Record/replay ADC port.  These must be called before neug_init
+ * (the rng thread calls adc_init, which rewinds the sample stream).
+ */
+int adc_replay_set_file (const char *path);
+void adc_replay_set_seed (uint32_t seed);
+void adc_replay_set_timing (uint32_t sample_rate, uint32_t latency_us);
+uint32_t adc_replay_samples (void);
+
+/* Close the capture file, after neug_fini.  */
+void adc_replay_close (void);
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ * adc-sim.c - ADC driver of simulated noise source.
+ *             This ADC driver generates samples as fast as possible,
+ *             with a profile of degraded noise source (biased, stuck,
+ *             correlated or burst failure), to measure the cost of
+ *             the health tests.
+ *
+ * This file is a part of NeuG, a True Random Number Generator
+ * implementation based on quantization error of ADC (for STM32F103).
+ *
+ * NeuG is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NeuG is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <rtthread.h>
+
+#include "adc.h"
+#include "adc-sim.h"
+
+#ifndef NEUG_SIM_SEED
+#define NEUG_SIM_SEED 0x01034649
+#endif
+
+/*
+ * Only the low NEUG_ADC_NOISE_BITS of a sample are noise, the rest is
+ * the constant "signal", like a real ADC.
+ */
+#if NEUG_ADC_NOISE_BITS < 32
+#define SIM_NOISE_MASK ((1UL << NEUG_ADC_NOISE_BITS) - 1)
+#else
+#define SIM_NOISE_MASK 0xffffffffUL
+#endif
+#define SIM_SIGNAL (0x00000800UL & ~SIM_NOISE_MASK)
+
+uint32_t adc_buf[NEUG_ADC_BUF_SIZE];
+
+static const char *const sim_profile_name[ADC_SIM_PROFILE_NUM] = {
+  "ideal", "biased", "stuck", "correlated", "burst"
+};
+
+static volatile int sim_profile = ADC_SIM_IDEAL;
+static volatile uint32_t sim_p1, sim_p2;
+static uint64_t sim_state = NEUG_SIM_SEED;
+static uint32_t sim_count;
+static uint32_t sim_last;
+
+void adc_sim_set_profile (int profile, uint32_t p1, uint32_t p2)
+{
+  sim_p1 = p1;
+  sim_p2 = p2;
+  sim_profile = profile;
+  sim_count = 0;
+}
+
+void adc_sim_set_seed (uint32_t seed)
+{
+  sim_state = seed;
+}
+
+/*
+ * Return the profile by NAME, or -1.
+ */
+int adc_sim_profile_find (const char *name)
+{
+  int i;
+
+  for (i = 0; i < ADC_SIM_PROFILE_NUM; i++)
+  {
+    if (!strcmp (name, sim_profile_name[i]))
+    {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+const char *adc_sim_profile_name (int profile)
+{
+  return sim_profile_name[profile];
+}
+
+/*
+ * Return the number of samples since the profile was set.
+ */
+uint32_t adc_sim_samples (void)
+{
+  return sim_count;
+}
+
+/* SplitMix64 */
+static uint32_t sim_rand (void)
+{
+  uint64_t z = (sim_state += 0x9e3779b97f4a7c15ULL);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+/* Return 1 with probability P/1000.  */
+static int sim_chance (uint32_t p)
+{
+  return (sim_rand () % 1000) < p;
+}
+
+static uint32_t sim_sample (void)
+{
+  uint32_t noise = sim_last;
+
+  switch (sim_profile)
+  {
+  case ADC_SIM_BIASED:
+    noise = sim_chance (sim_p1) ? 0 : sim_rand ();
+    break;
+  case ADC_SIM_STUCK:
+    if (sim_count < sim_p1)
+    {
+      noise = sim_rand ();
+    }
+    break;
+  case ADC_SIM_CORRELATED:
+    if (!sim_chance (sim_p1))
+    {
+      noise = sim_rand ();
+    }
+    break;
+  case ADC_SIM_BURST:
+    if (sim_p1 == 0 || sim_count % sim_p1 >= sim_p2)
+    {
+      noise = sim_rand ();
+    }
+    break;
+  default:
+    noise = sim_rand ();
+    break;
+  }
+
+  sim_count++;
+  sim_last = noise;
+  return SIM_SIGNAL | (noise & SIM_NOISE_MASK);
+}
+
+int adc_init (void)
+{
+  sim_count = 0;
+  sim_last = 0;
+  return 0;
+}
+
+void adc_start (void)
+{
+}
+
+void adc_start_conversion (int offset, int count)
+{
+  while (count--)
+  {
+    adc_buf[offset++] = sim_sample ();
+  }
+}
+
+int adc_wait_completion (void)
+{
+  return 0;
+}
+
+void adc_stop (void)
+{
+}
@@ -0,0 +1,25 @@
+#ifndef  __ADC_SIM_H__
+#define  __ADC_SIM_H__
+
+/*
+ * Profiles of the simulated noise source.  P1 and P2 are parameters
+ * of adc_sim_set_profile.
+ */
+#define ADC_SIM_IDEAL      0	/* Uniform noisy bits.                   */
+#define ADC_SIM_BIASED     1	/* P1/1000 of samples are zero.          */
+#define ADC_SIM_STUCK      2	/* Stuck at a value after P1 samples.    */
+#define ADC_SIM_CORRELATED 3	/* P1/1000 of samples repeat previous.   */
+#define ADC_SIM_BURST      4	/* Stuck for P2 samples, every P1.       */
+#define ADC_SIM_PROFILE_NUM 5
+
+/*
+ * Changing the profile takes effect at next conversion, it can be
+ * called while NeuG is running.
+ */
+void adc_sim_set_profile (int profile, uint32_t p1, uint32_t p2);
+void adc_sim_set_seed (uint32_t seed);
+int adc_sim_profile_find (const char *name);
+const char *adc_sim_profile_name (int profile);
+uint32_t adc_sim_samples (void);
+
+#endif
@@ -0,0 +1,194 @@
+/*
+ * blake2s.c -- Compute BLAKE2s hash
+ *
+ * This file is a part of NeuG, a True Random Number Generator
+ * implementation based on quantization error of ADC (for STM32F103).
+ *
+ * NeuG is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NeuG is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Reference: RFC 7693.  Unkeyed, with 32-byte output.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <rtthread.h>
+
+#if defined(PKG_USING_NEUG_BLAKE2S) || defined(PKG_NEUG_CONDITIONER_BLAKE2S)
+#include "blake2s.h"
+
+static const uint32_t blake2s_iv[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+  0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint8_t blake2s_sigma[10][16] = {
+  {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+  { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+  { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+  {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+  {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+  {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+  { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+  { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+  {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+  { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+};
+
+#define ROTR(x,n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+#define G(a,b,c,d,x,y)                          \
+  do {                                          \
+    v[a] = v[a] + v[b] + (x);                   \
+    v[d] = ROTR (v[d] ^ v[a], 16);              \
+    v[c] = v[c] + v[d];                         \
+    v[b] = ROTR (v[b] ^ v[c], 12);              \
+    v[a] = v[a] + v[b] + (y);                   \
+    v[d] = ROTR (v[d] ^ v[a], 8);               \
+    v[c] = v[c] + v[d];                         \
+    v[b] = ROTR (v[b] ^ v[c], 7);               \
+  } while (0)
+
+static uint32_t get_le32 (const uint8_t *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8)
+    | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void blake2s_compress (blake2s_context *ctx, const uint8_t *p,
+			      int last)
+{
+  uint32_t m[16];
+  uint32_t v[16];
+  int i;
+
+  for (i = 0; i < 16; i++)
+  {
+    m[i] = get_le32 (p + i * 4);
+  }
+
+  for (i = 0; i < 8; i++)
+  {
+    v[i] = ctx->h[i];
+    v[i + 8] = blake2s_iv[i];
+  }
+
+  v[12] ^= ctx->t[0];
+  v[13] ^= ctx->t[1];
+  if (last)
+  {
+    v[14] = ~v[14];
+  }
+
+  for (i = 0; i < 10; i++)
+  {
+    const uint8_t *s = blake2s_sigma[i];
+
+    G (0, 4,  8, 12, m[s[ 0]], m[s[ 1]]);
+    G (1, 5,  9, 13, m[s[ 2]], m[s[ 3]]);
+    G (2, 6, 10, 14, m[s[ 4]], m[s[ 5]]);
+    G (3, 7, 11, 15, m[s[ 6]], m[s[ 7]]);
+    G (0, 5, 10, 15, m[s[ 8]], m[s[ 9]]);
+    G (1, 6, 11, 12, m[s[10]], m[s[11]]);
+    G (2, 7,  8, 13, m[s[12]], m[s[13]]);
+    G (3, 4,  9, 14, m[s[14]], m[s[15]]);
+  }
+
+  for (i = 0; i < 8; i++)
+  {
+    ctx->h[i] ^= v[i] ^ v[i + 8];
+  }
+}
+
+static void blake2s_count (blake2s_context *ctx, uint32_t n)
+{
+  ctx->t[0] += n;
+  if (ctx->t[0] < n)
+  {
+    ctx->t[1]++;
+  }
+}
+
+void blake2s_start (blake2s_context *ctx)
+{
+  memcpy (ctx->h, blake2s_iv, sizeof ctx->h);
+  /* Parameter block: digest length 32, no key, fanout 1, depth 1.  */
+  ctx->h[0] ^= 0x01010000 | BLAKE2S_DIGEST_SIZE;
+  ctx->t[0] = ctx->t[1] = 0;
+  ctx->buflen = 0;
+}
+
+/*
+ * The last block must be compressed with the final flag, so a full
+ * buffer is kept until more input comes.
+ */
+void blake2s_update (blake2s_context *ctx, const uint8_t *input,
+		     unsigned int ilen)
+{
+  while (ilen)
+  {
+    unsigned int n;
+
+    if (ctx->buflen == BLAKE2S_BLOCK_SIZE)
+    {
+      blake2s_count (ctx, BLAKE2S_BLOCK_SIZE);
+      blake2s_compress (ctx, ctx->buffer, 0);
+      ctx->buflen = 0;
+    }
+
+    if (ctx->buflen == 0 && ilen > BLAKE2S_BLOCK_SIZE)
+    {
+      blake2s_count (ctx, BLAKE2S_BLOCK_SIZE);
+      blake2s_compress (ctx, input, 0);
+      input += BLAKE2S_BLOCK_SIZE;
+      ilen -= BLAKE2S_BLOCK_SIZE;
+      continue;
+    }
+
+    n = BLAKE2S_BLOCK_SIZE - ctx->buflen;
+    if (n > ilen)
+    {
+      n = ilen;
+    }
+
+    memcpy (ctx->buffer + ctx->buflen, input, n);
+    ctx->buflen += n;
+    input += n;
+    ilen -= n;
+  }
+}
+
+void blake2s_finish (blake2s_context *ctx,
+		     uint8_t output[BLAKE2S_DIGEST_SIZE])
+{
+  int i;
+
+  blake2s_count (ctx, ctx->buflen);
+  memset (ctx->buffer + ctx->buflen, 0, BLAKE2S_BLOCK_SIZE - ctx->buflen);
+  blake2s_compress (ctx, ctx->buffer, 1);
+
+  for (i = 0; i < 8; i++)
+  {
+    output[i * 4]     = (uint8_t)ctx->h[i];
+    output[i * 4 + 1] = (uint8_t)(ctx->h[i] >> 8);
+    output[i * 4 + 2] = (uint8_t)(ctx->h[i] >> 16);
+    output[i * 4 + 3] = (uint8_t)(ctx->h[i] >> 24);
+  }
+
+  memset (ctx, 0, sizeof (blake2s_context));
+}
+#endif
@@ -0,0 +1,256 @@
+/*
+ * conditioner.c - conditioning components for hash_df
+ *
+ * This file is a part of NeuG, a True Random Number Generator
+ * implementation based on quantization error of ADC (for STM32F103).
+ *
+ * NeuG is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NeuG is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include <rtthread.h>
+
+#include "conditioner.h"
+
+static void cond_sha256_starts (union neug_cond_ctx *ctx)
+{
+  tiny_sha2_starts (&ctx->sha256, 0);
+}
+
+static void cond_sha256_update (union neug_cond_ctx *ctx,
+				const uint8_t *input, int ilen)
+{
+  tiny_sha2_update (&ctx->sha256, (unsigned char *)input, ilen);
+}
+
+static void cond_sha256_finish (union neug_cond_ctx *ctx, uint8_t *output)
+{
+  tiny_sha2_finish (&ctx->sha256, output);
+}
+
+/* SHA-256: block of 64-byte, N=140 (see neug.c).  */
+const struct neug_conditioner neug_cond_sha256 = {
+  "sha256", 64, 32, 140,
+  cond_sha256_starts, cond_sha256_update, cond_sha256_finish
+};
+
+#if defined(PKG_USING_NEUG_SHA512) || defined(PKG_NEUG_CONDITIONER_SHA512)
+static void cond_sha512_starts (union neug_cond_ctx *ctx)
+{
+  sha512_start (&ctx->sha512);
+}
+
+static void cond_sha512_update (union neug_cond_ctx *ctx,
+				const uint8_t *input, int ilen)
+{
+  sha512_update (&ctx->sha512, input, ilen);
+}
+
+static void cond_sha512_finish (union neug_cond_ctx *ctx, uint8_t *output)
+{
+  sha512_finish (&ctx->sha512, output);
+}
+
+/*
+ * SHA-512: block of 128-byte, output of 512-bit.  N >= 2 * 128 and
+ * N >= (512 * 2) / 3.68.  We chose N=280, which corresponds to
+ * min-entropy >= 3.66, the same margin as N=140 for SHA-256.
+ */
+const struct neug_conditioner neug_cond_sha512 = {
+  "sha512", SHA512_BLOCK_SIZE, SHA512_DIGEST_SIZE, 280,
+  cond_sha512_starts, cond_sha512_update, cond_sha512_finish
+};
+#endif
+
+#if defined(PKG_USING_NEUG_BLAKE2S) || defined(PKG_NEUG_CONDITIONER_BLAKE2S)
+static void cond_blake2s_starts (union neug_cond_ctx *ctx)
+{
+  blake2s_start (&ctx->blake2s);
+}
+
+static void cond_blake2s_update (union neug_cond_ctx *ctx,
+				 const uint8_t *input, int ilen)
+{
+  blake2s_update (&ctx->blake2s, input, ilen);
+}
+
+static void cond_blake2s_finish (union neug_cond_ctx *ctx, uint8_t *output)
+{
+  blake2s_finish (&ctx->blake2s, output);
+}
+
+/* BLAKE2s: same sizes as SHA-256, N=140.  */
+const struct neug_conditioner neug_cond_blake2s = {
+  "blake2s", BLAKE2S_BLOCK_SIZE, BLAKE2S_DIGEST_SIZE, 140,
+  cond_blake2s_starts, cond_blake2s_update, cond_blake2s_finish
+};
+#endif
+
+#if defined(PKG_NEUG_CONDITIONER_SHA512)
+const struct neug_conditioner *const neug_cond_default = &neug_cond_sha512;
+#elif defined(PKG_NEUG_CONDITIONER_BLAKE2S)
+const struct neug_conditioner *const neug_cond_default = &neug_cond_blake2s;
+#else
+const struct neug_conditioner *const neug_cond_default = &neug_cond_sha256;
+#endif
+
+static const struct neug_conditioner *const cond_table[] = {
+  &neug_cond_sha256,
+#if defined(PKG_USING_NEUG_SHA512) || defined(PKG_NEUG_CONDITIONER_SHA512)
+  &neug_cond_sha512,
+#endif
+#if defined(PKG_USING_NEUG_BLAKE2S) || defined(PKG_NEUG_CONDITIONER_BLAKE2S)
+  &neug_cond_blake2s,
+#endif
+};
+
+const struct neug_conditioner *neug_conditioner_find (const char *name)
+{
+  unsigned int i;
+
+  for (i = 0; i < sizeof cond_table / sizeof cond_table[0]; i++)
+  {
+    if (!strcmp (cond_table[i]->name, name))
+    {
+      return cond_table[i];
+    }
+  }
+
+  return RT_NULL;
+}
+
+/*
+ * Known answer tests: the digest of "abc", and of the 896-bit message
+ * below, which takes two blocks of SHA-512 and BLAKE2s (and two blocks
+ * of data for SHA-256).  It is fed by pieces of 7 bytes, like the
+ * noise input of ep_process, crossing the block boundary.
+ */
+static const char kat_msg_2blk[] =
+  "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmn"
+  "hijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu";
+
+#define KAT_MSG_2BLK_LEN (sizeof kat_msg_2blk - 1)
+#define KAT_PIECE 7
+
+static const uint8_t kat_sha256_abc[32] = {
+  0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea,
+  0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+  0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c,
+  0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+};
+
+static const uint8_t kat_sha256_2blk[32] = {
+  0xcf, 0x5b, 0x16, 0xa7, 0x78, 0xaf, 0x83, 0x80,
+  0x03, 0x6c, 0xe5, 0x9e, 0x7b, 0x04, 0x92, 0x37,
+  0x0b, 0x24, 0x9b, 0x11, 0xe8, 0xf0, 0x7a, 0x51,
+  0xaf, 0xac, 0x45, 0x03, 0x7a, 0xfe, 0xe9, 0xd1,
+};
+
+#if defined(PKG_USING_NEUG_SHA512) || defined(PKG_NEUG_CONDITIONER_SHA512)
+static const uint8_t kat_sha512_abc[64] = {
+  0xdd, 0xaf, 0x35, 0xa1, 0x93, 0x61, 0x7a, 0xba,
+  0xcc, 0x41, 0x73, 0x49, 0xae, 0x20, 0x41, 0x31,
+  0x12, 0xe6, 0xfa, 0x4e, 0x89, 0xa9, 0x7e, 0xa2,
+  0x0a, 0x9e, 0xee, 0xe6, 0x4b, 0x55, 0xd3, 0x9a,
+  0x21, 0x92, 0x99, 0x2a, 0x27, 0x4f, 0xc1, 0xa8,
+  0x36, 0xba, 0x3c, 0x23, 0xa3, 0xfe, 0xeb, 0xbd,
+  0x45, 0x4d, 0x44, 0x23, 0x64, 0x3c, 0xe8, 0x0e,
+  0x2a, 0x9a, 0xc9, 0x4f, 0xa5, 0x4c, 0xa4, 0x9f,
+};
+
+static const uint8_t kat_sha512_2blk[64] = {
+  0x8e, 0x95, 0x9b, 0x75, 0xda, 0xe3, 0x13, 0xda,
+  0x8c, 0xf4, 0xf7, 0x28, 0x14, 0xfc, 0x14, 0x3f,
+  0x8f, 0x77, 0x79, 0xc6, 0xeb, 0x9f, 0x7f, 0xa1,
+  0x72, 0x99, 0xae, 0xad, 0xb6, 0x88, 0x90, 0x18,
+  0x50, 0x1d, 0x28, 0x9e, 0x49, 0x00, 0xf7, 0xe4,
+  0x33, 0x1b, 0x99, 0xde, 0xc4, 0xb5, 0x43, 0x3a,
+  0xc7, 0xd3, 0x29, 0xee, 0xb6, 0xdd, 0x26, 0x54,
+  0x5e, 0x96, 0xe5, 0x5b, 0x87, 0x4b, 0xe9, 0x09,
+};
+#endif
+
+#if defined(PKG_USING_NEUG_BLAKE2S) || defined(PKG_NEUG_CONDITIONER_BLAKE2S)
+static const uint8_t kat_blake2s_abc[32] = {
+  0x50, 0x8c, 0x5e, 0x8c, 0x32, 0x7c, 0x14, 0xe2,
+  0xe1, 0xa7, 0x2b, 0xa3, 0x4e, 0xeb, 0x45, 0x2f,
+  0x37, 0x45, 0x8b, 0x20, 0x9e, 0xd6, 0x3a, 0x29,
+  0x4d, 0x99, 0x9b, 0x4c, 0x86, 0x67, 0x59, 0x82,
+};
+
+static const uint8_t kat_blake2s_2blk[32] = {
+  0x35, 0x8d, 0xd2, 0xed, 0x07, 0x80, 0xd4, 0x05,
+  0x4e, 0x76, 0xcb, 0x6f, 0x3a, 0x5b, 0xce, 0x28,
+  0x41, 0xe8, 0xe2, 0xf5, 0x47, 0x43, 0x1d, 0x4d,
+  0x09, 0xdb, 0x21, 0xb6, 0x6d, 0x94, 0x1f, 0xc7,
+};
+#endif
+
+/*
+ * Return 0 on success.
+ * Return -1 when the conditioner doesn't give the known answer.
+ */
+int neug_conditioner_selftest (const struct neug_conditioner *cond)
+{
+  union neug_cond_ctx ctx;
+  uint8_t output[NEUG_COND_DIGEST_MAX];
+  const uint8_t *expected, *expected_2blk;
+  unsigned int i;
+
+  if (cond == &neug_cond_sha256)
+  {
+    expected = kat_sha256_abc;
+    expected_2blk = kat_sha256_2blk;
+  }
+#if defined(PKG_USING_NEUG_SHA512) || defined(PKG_NEUG_CONDITIONER_SHA512)
+  else if (cond == &neug_cond_sha512)
+  {
+    expected = kat_sha512_abc;
+    expected_2blk = kat_sha512_2blk;
+  }
+#endif
+#if defined(PKG_USING_NEUG_BLAKE2S) || defined(PKG_NEUG_CONDITIONER_BLAKE2S)
+  else if (cond == &neug_cond_blake2s)
+  {
+    expected = kat_blake2s_abc;
+    expected_2blk = kat_blake2s_2blk;
+  }
+#endif
+  else
+  {
+    return -1;
+  }
+
+  cond->starts (&ctx);
+  cond->update (&ctx, (const uint8_t *)"ab", 2);
+  cond->update (&ctx, (const uint8_t *)"c", 1);
+  cond->finish (&ctx, output);
+
+  if (memcmp (output, expected, cond->digest_size))
+  {
+    return -1;
+  }
+
+  cond->starts (&ctx);
+  for (i = 0; i < KAT_MSG_2BLK_LEN; i += KAT_PIECE)
+  {
+    cond->update (&ctx, (const uint8_t *)kat_msg_2blk + i, KAT_PIECE);
+  }
+
+  cond->finish (&ctx, output);
+
+  return memcmp (output, expected_2blk, cond->digest_size) ? -1 : 0;
+}
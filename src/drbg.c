@@ -0,0 +1,164 @@
+/*
+ * drbg.c -- Hash_DRBG of SHA-256
+ *
+ * This file is a part of NeuG, a True Random Number Generator
+ * implementation based on quantization error of ADC (for STM32F103).
+ *
+ * NeuG is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NeuG is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Reference: NIST SP 800-90A Rev. 1, 10.1.1 Hash_DRBG.
+ * Additional input is not supported.  The reseed interval is the
+ * business of the caller, see neug_read.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <rtthread.h>
+
+#ifdef PKG_USING_NEUG_DRBG
+#include "tiny_sha2.h"
+#include "drbg.h"
+
+#define DRBG_HASH_SIZE 32
+
+/*
+ * Hash_df (10.3.1) of the concatenation of PREFIX (when >= 0), A and
+ * B, into OUTPUT of DRBG_SEEDLEN.
+ */
+static void drbg_hash_df (uint8_t *output, int prefix,
+			  const uint8_t *a, int alen,
+			  const uint8_t *b, int blen)
+{
+  tiny_sha2_context ctx;
+  uint8_t head[6];
+  uint8_t digest[DRBG_HASH_SIZE];
+  int i, n;
+
+  head[1] = 0;			/* no_of_bits_to_return, big endian */
+  head[2] = 0;
+  head[3] = (DRBG_SEEDLEN * 8) >> 8;
+  head[4] = (DRBG_SEEDLEN * 8) & 0xff;
+  head[5] = prefix;
+
+  for (i = 0; i < DRBG_SEEDLEN; i += n)
+  {
+    head[0] = i / DRBG_HASH_SIZE + 1;	/* counter */
+
+    tiny_sha2_starts (&ctx, 0);
+    tiny_sha2_update (&ctx, head, prefix >= 0 ? 6 : 5);
+    tiny_sha2_update (&ctx, (uint8_t *)a, alen);
+    if (blen)
+    {
+      tiny_sha2_update (&ctx, (uint8_t *)b, blen);
+    }
+    tiny_sha2_finish (&ctx, digest);
+
+    n = DRBG_SEEDLEN - i < DRBG_HASH_SIZE ? DRBG_SEEDLEN - i : DRBG_HASH_SIZE;
+    memcpy (output + i, digest, n);
+  }
+
+  memset (digest, 0, sizeof digest);
+  memset (&ctx, 0, sizeof ctx);
+}
+
+/* V = (V + A) mod 2^seedlen, where A is big endian of ALEN bytes.  */
+static void drbg_add (uint8_t *v, const uint8_t *a, int alen)
+{
+  unsigned int carry = 0;
+  int i, j;
+
+  for (i = DRBG_SEEDLEN - 1, j = alen - 1; i >= 0; i--, j--)
+  {
+    carry += v[i] + (j >= 0 ? a[j] : 0);
+    v[i] = carry;
+    carry >>= 8;
+  }
+}
+
+static void drbg_update_c (drbg_context *ctx)
+{
+  drbg_hash_df (ctx->c, 0x00, ctx->v, DRBG_SEEDLEN, RT_NULL, 0);
+  ctx->reseed_counter = 1;
+}
+
+/*
+ * ENTROPY includes the nonce, PERS is the personalization string.
+ */
+void drbg_instantiate (drbg_context *ctx, const uint8_t *entropy, int elen,
+		       const uint8_t *pers, int plen)
+{
+  drbg_hash_df (ctx->v, -1, entropy, elen, pers, plen);
+  drbg_update_c (ctx);
+}
+
+void drbg_reseed (drbg_context *ctx, const uint8_t *entropy, int elen)
+{
+  uint8_t v[DRBG_SEEDLEN];
+
+  memcpy (v, ctx->v, DRBG_SEEDLEN);
+  drbg_hash_df (ctx->v, 0x01, v, DRBG_SEEDLEN, entropy, elen);
+  drbg_update_c (ctx);
+  memset (v, 0, sizeof v);
+}
+
+/*
+ * Generate LEN bytes (<= DRBG_MAX_REQUEST) into OUTPUT.
+ */
+void drbg_generate (drbg_context *ctx, uint8_t *output, int len)
+{
+  tiny_sha2_context sha;
+  uint8_t data[DRBG_SEEDLEN];
+  uint8_t digest[DRBG_HASH_SIZE];
+  uint8_t counter[4];
+  const uint8_t one = 1;
+  uint8_t prefix = 0x03;
+  int n;
+
+  /* Hashgen */
+  memcpy (data, ctx->v, DRBG_SEEDLEN);
+  while (len > 0)
+  {
+    tiny_sha2 (data, DRBG_SEEDLEN, digest, 0);
+    n = len < DRBG_HASH_SIZE ? len : DRBG_HASH_SIZE;
+    memcpy (output, digest, n);
+    output += n;
+    len -= n;
+    drbg_add (data, &one, 1);
+  }
+
+  /* V = V + Hash (0x03 || V) + C + reseed_counter */
+  tiny_sha2_starts (&sha, 0);
+  tiny_sha2_update (&sha, &prefix, 1);
+  tiny_sha2_update (&sha, ctx->v, DRBG_SEEDLEN);
+  tiny_sha2_finish (&sha, digest);
+
+  counter[0] = ctx->reseed_counter >> 24;
+  counter[1] = ctx->reseed_counter >> 16;
+  counter[2] = ctx->reseed_counter >> 8;
+  counter[3] = ctx->reseed_counter;
+
+  drbg_add (ctx->v, digest, DRBG_HASH_SIZE);
+  drbg_add (ctx->v, ctx->c, DRBG_SEEDLEN);
+  drbg_add (ctx->v, counter, 4);
+  ctx->reseed_counter++;
+
+  memset (data, 0, sizeof data);
+  memset (digest, 0, sizeof digest);
+  memset (&sha, 0, sizeof sha);
+}
+#endif
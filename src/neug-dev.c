@@ -0,0 +1,342 @@
+/*
+ * neug-dev.c - RT-Thread devices "hwrng" and "urandom"
+ *
+ * This file is a part of NeuG, a True Random Number Generator
+ * implementation based on quantization error of ADC (for STM32F103).
+ *
+ * NeuG is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NeuG is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+
+#include <rtthread.h>
+
+#if defined(PKG_USING_NEUG_DEVICE) && defined(RT_USING_DEVICE)
+#include <rtdevice.h>
+#ifdef RT_USING_POSIX_DEVIO
+#include <dfs_file.h>
+#include <fcntl.h>
+#include <poll.h>
+#endif
+
+#include "neug.h"
+#include "neug-dev.h"
+
+/*
+ * Two character devices: "hwrng" gives the words of the ring buffer,
+ * and "urandom" gives the output of the DRBG (or the words of the ring
+ * buffer, without PKG_USING_NEUG_DRBG).  A read fills the whole
+ * buffer, by neug_get_words, directly into the buffer when it's
+ * aligned, and through NEUG_DEV_CHUNK words on stack when not.
+ *
+ * Through DFS (/dev/hwrng), a read with O_NONBLOCK takes only the
+ * words ready in the ring buffer, and poll/select reports POLLIN when
+ * there are.  "urandom" is readable when the DRBG is seeded; until
+ * then, each check seeds it by the words ready.  The generator
+ * calls dev_notify for each output, which wakes up the pollers.  In
+ * pull mode, a read runs the generator, so it's always readable.
+ */
+#ifndef NEUG_DEV_CHUNK
+#define NEUG_DEV_CHUNK 16
+#endif
+
+/* A read is done up to this size, it's returned as int.  */
+#define NEUG_DEV_READ_MAX (INT_MAX & ~3)
+
+/* The read of rt_device returns rt_ssize_t since 5.0.0.  */
+#if defined(RT_VERSION_CHECK)
+#if RTTHREAD_VERSION >= RT_VERSION_CHECK(5, 0, 0)
+#define DEV_SSIZE_T rt_ssize_t
+#endif
+#endif
+#ifndef DEV_SSIZE_T
+#define DEV_SSIZE_T rt_size_t
+#endif
+
+#define NEUG_DEVS 2
+
+struct neug_dev {
+  struct rt_device parent;
+  const char *name;
+  int cls;			/* NEUG_CLASS_*, or -1 for the ring buffer */
+};
+
+static struct neug_dev neug_devs[NEUG_DEVS] = {
+  { .name = "hwrng", .cls = -1 },
+#ifdef PKG_USING_NEUG_DRBG
+  { .name = "urandom", .cls = NEUG_CLASS_DRBG },
+#else
+  { .name = "urandom", .cls = -1 },
+#endif
+};
+
+static int dev_registered;
+
+/* Fill LEN bytes at P from the ring buffer, waiting for the words.  */
+static void dev_get (uint8_t *p, int len)
+{
+  uint32_t tmp[NEUG_DEV_CHUNK];
+
+  if (((uintptr_t)p & 3) == 0)
+  {
+    neug_get_words ((uint32_t *)p, len / 4);
+    p += len & ~3;
+    len &= 3;
+  }
+
+  while (len > 0)
+  {
+    int m = len < (int)sizeof tmp ? len : (int)sizeof tmp;
+
+    neug_get_words (tmp, (m + 3) / 4);
+    memcpy (p, tmp, m);
+    p += m;
+    len -= m;
+  }
+
+  memset (tmp, 0, sizeof tmp);
+}
+
+/* Fill LEN bytes at P, by the class of ND.  Return -1 on error.  */
+static int dev_fill (struct neug_dev *nd, void *p, int len)
+{
+  if (nd->cls < 0)
+  {
+    dev_get ((uint8_t *)p, len);
+    return len;
+  }
+
+  return neug_read (nd->cls, p, len);
+}
+
+static DEV_SSIZE_T dev_read (rt_device_t dev, rt_off_t pos, void *buffer,
+                             rt_size_t size)
+{
+  if (size > NEUG_DEV_READ_MAX)
+  {
+    size = NEUG_DEV_READ_MAX;
+  }
+
+  if (dev_fill ((struct neug_dev *)dev, buffer, (int)size) < 0)
+  {
+    rt_set_errno (-RT_EIO);
+    return 0;
+  }
+
+  return size;
+}
+
+#ifdef RT_USING_DEVICE_OPS
+static const struct rt_device_ops dev_ops = {
+  RT_NULL, RT_NULL, RT_NULL, dev_read, RT_NULL, RT_NULL
+};
+#endif
+
+#ifdef RT_USING_POSIX_DEVIO
+#ifndef PKG_USING_NEUG_PULL
+/*
+ * Copy the words ready in the ring buffer into P, up to LEN bytes.  A
+ * whole word is consumed for the last bytes.  Return the bytes copied.
+ */
+static int dev_get_nonblock (uint8_t *p, int len)
+{
+  struct neug_span span;
+  int i, n = 0, k = 0;
+
+  if (neug_peek (&span) == 0)
+  {
+    return 0;
+  }
+
+  for (i = 0; i < 2 && n < len; i++)
+  {
+    int m = span.n[i] * 4 < len - n ? span.n[i] * 4 : len - n;
+
+    memcpy (p + n, span.p[i], m);
+    n += m;
+    k += (m + 3) / 4;
+  }
+
+  neug_commit (k);
+  return n;
+}
+#endif
+
+/* Return 1 when ND can be read without waiting for the noise source.  */
+static int dev_readable (struct neug_dev *nd)
+{
+#ifdef PKG_USING_NEUG_PULL
+  /* Nobody else runs the generator, a read runs it.  */
+  return 1;
+#else
+#ifdef PKG_USING_NEUG_DRBG
+  if (nd->cls >= 0)
+  {
+    return neug_drbg_try_seed () == 0;
+  }
+#endif
+
+  return neug_words_avail () > 0;
+#endif
+}
+
+static int dev_fops_open (struct dfs_file *fd)
+{
+  return 0;
+}
+
+static int dev_fops_close (struct dfs_file *fd)
+{
+  return 0;
+}
+
+#ifdef RT_USING_DFS_V2
+static ssize_t dev_fops_read (struct dfs_file *fd, void *buf, size_t count,
+                              off_t *pos)
+#else
+static int dev_fops_read (struct dfs_file *fd, void *buf, size_t count)
+#endif
+{
+  struct neug_dev *nd = (struct neug_dev *)fd->vnode->data;
+
+  if (count == 0)
+  {
+    return 0;
+  }
+
+  if (count > NEUG_DEV_READ_MAX)
+  {
+    count = NEUG_DEV_READ_MAX;
+  }
+
+  if (fd->flags & O_NONBLOCK)
+  {
+#ifndef PKG_USING_NEUG_PULL
+    if (nd->cls < 0)
+    {
+      int n = dev_get_nonblock ((uint8_t *)buf, count);
+
+      return n > 0 ? n : -EAGAIN;
+    }
+#endif
+    if (!dev_readable (nd))
+    {
+      return -EAGAIN;
+    }
+  }
+
+  return dev_fill (nd, buf, count) < 0 ? -EIO : (int)count;
+}
+
+static int dev_fops_poll (struct dfs_file *fd, struct rt_pollreq *req)
+{
+  struct neug_dev *nd = (struct neug_dev *)fd->vnode->data;
+
+  /* Added first, so that a wakeup after the check is not missed.  */
+  rt_poll_add (&nd->parent.wait_queue, req);
+  return dev_readable (nd) ? POLLIN : 0;
+}
+
+static const struct dfs_file_ops dev_fops = {
+  .open = dev_fops_open,
+  .close = dev_fops_close,
+  .read = dev_fops_read,
+  .poll = dev_fops_poll,
+};
+
+static void dev_notify (void)
+{
+  int i;
+
+  for (i = 0; i < NEUG_DEVS; i++)
+  {
+    rt_wqueue_wakeup (&neug_devs[i].parent.wait_queue, (void *)POLLIN);
+  }
+}
+#endif
+
+/**
+ * @brief  Register the devices.  NeuG must be initialized already.
+ * @return 0 on success, -1 on error.
+ */
+int neug_dev_register (void)
+{
+  int i;
+
+  if (dev_registered)
+  {
+    return -1;
+  }
+
+  for (i = 0; i < NEUG_DEVS; i++)
+  {
+    struct rt_device *dev = &neug_devs[i].parent;
+
+    dev->type = RT_Device_Class_Char;
+#ifdef RT_USING_DEVICE_OPS
+    dev->ops = &dev_ops;
+#else
+    dev->read = dev_read;
+#endif
+    if (rt_device_register (dev, neug_devs[i].name, RT_DEVICE_FLAG_RDONLY)
+        != RT_EOK)
+    {
+      while (i-- > 0)
+      {
+        rt_device_unregister (&neug_devs[i].parent);
+      }
+
+      return -1;
+    }
+
+#ifdef RT_USING_POSIX_DEVIO
+    /* After rt_device_register, which clears them.  */
+    dev->fops = &dev_fops;
+#endif
+  }
+
+#ifdef RT_USING_POSIX_DEVIO
+  neug_set_notify (dev_notify);
+#endif
+  dev_registered = 1;
+  return 0;
+}
+
+/**
+ * @brief  Unregister the devices, before neug_fini.
+ */
+void neug_dev_unregister (void)
+{
+  int i;
+
+  if (!dev_registered)
+  {
+    return;
+  }
+
+#ifdef RT_USING_POSIX_DEVIO
+  neug_set_notify (RT_NULL);
+#endif
+  for (i = 0; i < NEUG_DEVS; i++)
+  {
+    rt_device_unregister (&neug_devs[i].parent);
+  }
+
+  dev_registered = 0;
+}
+
+INIT_ENV_EXPORT(neug_dev_register);
+#endif
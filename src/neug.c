@@ -22,15 +22,39 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE		/* for sched_getcpu */
+#endif
 #include <stdint.h>
 #include <string.h>
 
 #include <rtthread.h>
+#if defined(__BMI2__) || defined(__SSSE3__)
+#include <x86intrin.h>
+#endif
+#if defined(RT_USING_SMP)
+#include <rthw.h>
+#elif defined(__linux__)
+#include <sched.h>
+#endif
 
 #include "neug.h"
 #include "sys-neug.h"
 #include "adc.h"
-#include "tiny_sha2.h"
+#include "conditioner.h"
+#include "neug_trace.h"
+#ifdef PKG_USING_NEUG_DRBG
+#include "drbg.h"
+#endif
+#ifdef PKG_USING_NEUG_SEED_FILE
+#include "seed.h"
+#if defined(RT_USING_SYSTEM_WORKQUEUE) && !defined(PKG_USING_NEUG_PULL)
+#include <rtdevice.h>
+#endif
+#if !defined(PKG_USING_NEUG_DRBG)
+#error "PKG_USING_NEUG_SEED_FILE needs PKG_USING_NEUG_DRBG"
+#endif
+#endif
 
 /* CRC-32/MPGE-2 */
 static const uint32_t crc32_rv_table[256] = {
@@ -102,16 +126,104 @@ void crc32_rv_stop (void)
 {
 }
 
-#define SHA256_DIGEST_SIZE  32
-
 #define MODE_CONDITION   0x01
 
+#define EP_ROUND_RAW_INPUTS 32
+#define EP_ROUND_RAW_DATA_INPUTS 32
+
+/*
+ * In pull mode (PKG_USING_NEUG_PULL), there is no rng thread: the
+ * generator runs in the caller of the consumer API, and there are no
+ * mutexes nor events.  It's for a single thread.
+ */
+#ifdef PKG_USING_NEUG_PULL
+#if defined(PKG_USING_NEUG_ADC_DUTY_CYCLE)
+#error "PKG_USING_NEUG_ADC_DUTY_CYCLE needs the rng thread"
+#endif
+#if defined(PKG_USING_NEUG_COND_WORKERS)
+#error "PKG_USING_NEUG_COND_WORKERS needs the rng thread"
+#endif
+#define RNG_LOCK(m)
+#define RNG_UNLOCK(m)
+#define RNG_SEND(e, set)
+#else
+#define RNG_LOCK(m)       rt_mutex_take(m, RT_WAITING_FOREVER)
+#define RNG_UNLOCK(m)     rt_mutex_release(m)
+#define RNG_SEND(e, set)  rt_event_send(e, set)
+
 struct rt_mutex mode_mtx;
 struct rt_event mode_cond;
+#endif
+
+/*
+ * Conditioning workers (PKG_USING_NEUG_COND_WORKERS): the hash
+ * function of hash_df is computed by NEUG_COND_WORKERS threads, with
+ * NEUG_COND_QUEUE outputs in flight.  See cond_worker.
+ */
+#ifdef PKG_USING_NEUG_COND_WORKERS
+#if defined(PKG_USING_NEUG_ADC_DUTY_CYCLE)
+#error "PKG_USING_NEUG_ADC_DUTY_CYCLE can't be used with the workers"
+#endif
+#ifndef NEUG_COND_WORKERS
+#define NEUG_COND_WORKERS 2
+#endif
+#ifndef NEUG_COND_QUEUE
+#define NEUG_COND_QUEUE (NEUG_COND_WORKERS * 2)
+#endif
+#if NEUG_COND_QUEUE < NEUG_COND_WORKERS
+#error "NEUG_COND_QUEUE should be NEUG_COND_WORKERS or more"
+#endif
+#endif
+
+/*
+ * Only NEUG_ADC_NOISE_BITS (the low bits) of a sample go to CRC32
+ * filter, packed into words.  A word (four bytes) of the filter output
+ * is computed from EP_WORD_SAMPLES samples, that is, a byte of noise
+ * is from a sample, or from 8/NEUG_ADC_NOISE_BITS samples.
+ */
+#if NEUG_ADC_NOISE_BITS >= 8
+#define EP_WORD_SAMPLES 4
+#else
+#define EP_WORD_SAMPLES (32 / NEUG_ADC_NOISE_BITS)
+#endif
+#define EP_PACK_SAMPLES (32 / NEUG_ADC_NOISE_BITS) /* in a packed word */
+#define EP_SAMPLES(bytes) ((bytes) / 4 * EP_WORD_SAMPLES)
+
+#if (NEUG_ADC_NOISE_BITS & (NEUG_ADC_NOISE_BITS - 1)) != 0 \
+  || NEUG_ADC_NOISE_BITS > 32
+#error "NEUG_ADC_NOISE_BITS should be 1, 2, 4, 8, 16 or 32"
+#endif
+
+/*
+ * A conversion may have several outputs' worth of samples, when
+ * adc_buf is large enough.
+ */
+#if NEUG_ADC_BUF_SIZE < EP_SAMPLES (EP_ROUND_RAW_INPUTS)
+#error "adc_buf is too small"
+#elif NEUG_ADC_BUF_SIZE >= EP_SAMPLES (NEUG_COND_NOISE_INPUTS_MIN)
+#define EP_OUTPUTS_MAX \
+  (NEUG_ADC_BUF_SIZE / EP_SAMPLES (NEUG_COND_NOISE_INPUTS_MIN))
+#else
+#define EP_OUTPUTS_MAX 1
+#endif
 
-static tiny_sha2_context tiny_sha2_ctx;
-static uint32_t tiny_sha2_input[64/sizeof(uint32_t)];
-static uint32_t tiny_sha2_output[SHA256_DIGEST_SIZE/sizeof (uint32_t)];
+/*
+ * hash_df input string: initial string (8-byte), noise (N-byte,
+ * including the three-byte in the initial string) and the feedback
+ * from previous output.
+ */
+#define EP_MSG_SIZE \
+  RT_ALIGN (NEUG_COND_NOISE_INPUTS_MAX + 5 + NEUG_COND_DIGEST_MAX / 2, 4)
+
+static const struct neug_conditioner *cond;
+#ifndef PKG_USING_NEUG_COND_WORKERS
+static union neug_cond_ctx cond_ctx;
+#endif
+static uint32_t ep_msg[EP_OUTPUTS_MAX * EP_MSG_SIZE / sizeof (uint32_t)];
+static uint32_t cond_output[EP_OUTPUTS_MAX * NEUG_COND_DIGEST_MAX
+			    / sizeof (uint32_t)];
+static uint32_t cond_feedback[NEUG_COND_DIGEST_MAX / 2 / sizeof (uint32_t)];
+static uint32_t *cond_out = cond_output; /* Output of the last turn */
 
 /*
  * To be a full entropy source, the requirement is to have N samples
@@ -128,8 +240,7 @@ static uint32_t tiny_sha2_output[SHA256_DIGEST_SIZE/sizeof (uint32_t)];
  *     primitive shall be provided as input to the conditioning
  *     function to produce full entropy output.
  *
- * For us, cryptographic primitive is SHA-256 and its blocksize is
- * 512-bit (64-byte), thus, N >= 128.
+ * For SHA-256, its blocksize is 512-bit (64-byte), thus, N >= 128.
  *
  * We chose N=140.  Note that we have "additional bits" of 16-byte for
  * last block (feedback from previous output of SHA-256) to feed
@@ -137,23 +248,22 @@ static uint32_t tiny_sha2_output[SHA256_DIGEST_SIZE/sizeof (uint32_t)];
  *
  * N=140 corresponds to min-entropy >= 3.68.
  *
+ * N is defined by the conditioner (noise_inputs), see conditioner.c
+ * for other hash functions.
  */
-#define NUM_NOISE_INPUTS 140
 
-#define EP_ROUND_0 0 /* initial-five-byte and 3-byte, then 56-byte-input */
-#define EP_ROUND_1 1 /* 64-byte-input */
-#define EP_ROUND_2 2 /* 17-byte-input */
+#define EP_ROUND_CONDITIONED 0 /* 8-byte initial string, N-byte-input */
 #define EP_ROUND_RAW      3 /* 32-byte-input */
 #define EP_ROUND_RAW_DATA 4 /* 32-byte-input */
 
-#define EP_ROUND_0_INPUTS 56
-#define EP_ROUND_1_INPUTS 64
-#define EP_ROUND_2_INPUTS 17
-#define EP_ROUND_RAW_INPUTS 32
-#define EP_ROUND_RAW_DATA_INPUTS 32
-
 static uint8_t ep_round;
 
+static uint32_t ep_initial[2];	/* Initial string of hash_df */
+static uint16_t ep_pos;		/* Next byte in the input of hash_df */
+static uint16_t ep_hashed;	/* Bytes already computed by the hash */
+static uint16_t ep_left;	/* Samples to be converted for an output */
+static uint16_t ep_count;	/* Samples in the conversion */
+
 static void noise_source_continuous_test (uint8_t noise);
 static void noise_source_continuous_test_word (uint8_t b0, uint8_t b1,
 					       uint8_t b2, uint8_t b3);
@@ -164,6 +274,7 @@ static void noise_source_continuous_test_word (uint8_t b0, uint8_t b1,
  *  Initial five bytes are:
  *    1,          : counter = 1
  *    0, 0, 1, 0  : no_of_bits_returned (in big endian)
+ *                  (0, 0, 2, 0 for output of 512-bit)
  *
  *  Then, three-byte from noise source follows.
  *
@@ -173,6 +284,7 @@ static void noise_source_continuous_test_word (uint8_t b0, uint8_t b1,
 static void ep_fill_initial_string (void)
 {
   uint32_t v = crc32_rv_get ();
+  uint32_t bits = cond->digest_size * 8;
   uint8_t b1, b2, b3;
 
   b3 = v >> 24;
@@ -183,8 +295,45 @@ static void ep_fill_initial_string (void)
   noise_source_continuous_test (b2);
   noise_source_continuous_test (b3);
 
-  adc_buf[0] = 0x01000001;
-  adc_buf[1] = (v & 0xffffff00);
+  ep_initial[0] = 0x01 | ((bits >> 24) << 8) | (((bits >> 16) & 0xff) << 16)
+    | (((bits >> 8) & 0xff) << 24);
+  ep_initial[1] = (bits & 0xff) | (v & 0xffffff00);
+}
+
+/*
+ * Start a conversion for the input of hash_df.
+ *
+ * When adc_buf can hold N samples, a conversion has all samples for
+ * one output or more, and they are processed at once.  Otherwise, a
+ * conversion ends at the block boundary, so that the hash function
+ * can compute the block while next conversion is going on.
+ */
+static void ep_start_conversion (void)
+{
+  int samples = EP_SAMPLES (cond->noise_inputs);
+  int count;
+
+  if (NEUG_ADC_BUF_SIZE >= samples)
+  {
+    count = (NEUG_ADC_BUF_SIZE / samples) * samples;
+  }
+  else
+  {
+    count = EP_SAMPLES (cond->block_size - (ep_pos % cond->block_size));
+
+    if (count > ep_left)
+    {
+      count = ep_left;
+    }
+
+    if (count > NEUG_ADC_BUF_SIZE)
+    {
+      count = NEUG_ADC_BUF_SIZE / EP_WORD_SAMPLES * EP_WORD_SAMPLES;
+    }
+  }
+
+  ep_count = count;
+  adc_start_conversion (0, count);
 }
 
 static void ep_init (int mode)
@@ -192,7 +341,7 @@ static void ep_init (int mode)
   if (mode == NEUG_MODE_RAW)
   {
     ep_round = EP_ROUND_RAW;
-    adc_start_conversion (0, EP_ROUND_RAW_INPUTS);
+    adc_start_conversion (0, EP_SAMPLES (EP_ROUND_RAW_INPUTS));
   }
   else if (mode == NEUG_MODE_RAW_DATA)
   {
@@ -201,10 +350,76 @@ static void ep_init (int mode)
   }
   else
   {
-    ep_round = EP_ROUND_0;
+    ep_round = EP_ROUND_CONDITIONED;
     ep_fill_initial_string ();
-    adc_start_conversion (2, EP_ROUND_0_INPUTS);
+    ep_pos = sizeof ep_initial;
+    ep_hashed = 0;
+    ep_left = EP_SAMPLES (cond->noise_inputs);
+    ep_start_conversion ();
+  }
+}
+
+#if NEUG_ADC_NOISE_BITS < 32
+#define EP_NOISE_MASK ((1UL << NEUG_ADC_NOISE_BITS) - 1)
+
+/*
+ * Pack the noisy bits of EP_PACK_SAMPLES samples into a word, the
+ * first sample at LSB.
+ */
+static uint32_t ep_pack (const uint32_t *s)
+{
+#if defined(__SSSE3__) && NEUG_ADC_NOISE_BITS == 8
+  /* Gather the lowest byte of four samples.  */
+  const __m128i sel = _mm_set_epi32 (-1, -1, -1, 0x0c080400);
+  __m128i x = _mm_loadu_si128 ((const __m128i *)s);
+
+  return _mm_cvtsi128_si32 (_mm_shuffle_epi8 (x, sel));
+#elif defined(__BMI2__) && NEUG_ADC_NOISE_BITS < 16
+  /* Two samples at once.  */
+  const uint64_t mask = EP_NOISE_MASK | ((uint64_t)EP_NOISE_MASK << 32);
+  uint32_t v = 0;
+  int i;
+
+  for (i = 0; i < EP_PACK_SAMPLES; i += 2)
+  {
+    uint64_t x = s[i] | ((uint64_t)s[i + 1] << 32);
+
+    v |= (uint32_t)_pext_u64 (x, mask) << (i * NEUG_ADC_NOISE_BITS);
+  }
+
+  return v;
+#else
+  uint32_t v = 0;
+  int i;
+
+  for (i = 0; i < EP_PACK_SAMPLES; i++)
+  {
+    v |= (s[i] & EP_NOISE_MASK) << (i * NEUG_ADC_NOISE_BITS);
+  }
+
+  return v;
+#endif
+}
+#endif
+
+/*
+ * Put EP_WORD_SAMPLES samples to CRC32 filter.
+ */
+static void ep_filter_word (const uint32_t *s)
+{
+#if NEUG_ADC_NOISE_BITS == 32
+  crc32_rv_step (s[0]);
+  crc32_rv_step (s[1]);
+  crc32_rv_step (s[2]);
+  crc32_rv_step (s[3]);
+#else
+  int i;
+
+  for (i = 0; i < EP_WORD_SAMPLES; i += EP_PACK_SAMPLES)
+  {
+    crc32_rv_step (ep_pack (s + i));
   }
+#endif
 }
 
 static void ep_fill_wbuf_v (int i, int test, uint32_t v)
@@ -221,101 +436,155 @@ static void ep_fill_wbuf_v (int i, int test, uint32_t v)
     noise_source_continuous_test_word (b0, b1, b2, b3);
   }
 
-  tiny_sha2_input[i] = v;
+  ep_msg[i] = v;
 }
 
+/*
+ * The input of hash_df is:
+ *
+ *   initial string (8-byte), noise (N-4 bytes, a word from CRC32 of
+ *   four samples), one byte of noise (the rest three-byte goes to the
+ *   initial string of next turn), and feedback (the first half of
+ *   previous output).
+ *
+ * All samples of the conversion are filtered and tested first, then
+ * next conversion is started, and then the hash function computes
+ * the outputs completed (and the blocks completed, for a partial
+ * output).
+ *
+ * The outputs are written to DEST (of ROOM words) when they fit, so
+ * that the generator can put them into the ring buffer without copy,
+ * otherwise to cond_output.  Feedback is kept in cond_feedback.
+ *
+ * With the conditioning workers, the hash function is not computed
+ * here; the outputs completed are left in ep_msg for cond_submit.
+ */
 /* Here, we assume a little endian architecture.  */
-static int ep_process (int mode)
+static int ep_process (int mode, uint32_t *dest, int room)
 {
   int i, n;
   uint32_t v;
 
-  if (ep_round == EP_ROUND_0)/* wbuf fill (3 + 5 + 56 bytes)*/
+  if (ep_round == EP_ROUND_CONDITIONED)
   {
-    tiny_sha2_starts(&tiny_sha2_ctx, 0);
-    tiny_sha2_input[0] = adc_buf[0];
-    tiny_sha2_input[1] = adc_buf[1];
-
-    for (i = 0; i < EP_ROUND_0_INPUTS / 4; i++)
+    const uint32_t *s = adc_buf;
+    uint8_t *msg = (uint8_t *)ep_msg;
+    int count = ep_count;
+    int pos = ep_pos;
+    int outputs = 0;
+#ifndef PKG_USING_NEUG_COND_WORKERS
+    int fb_pos = cond->noise_inputs + 5;
+    int fb = cond->digest_size / 2;
+#endif
+    int words = cond->digest_size / sizeof (uint32_t);
+
+    NEUG_TRACE_BEGIN (NEUG_TRACE_FILTER);
+    while (count)
     {
-      crc32_rv_step (adc_buf[i*4 + 2]);
-      crc32_rv_step (adc_buf[i*4 + 3]);
-      crc32_rv_step (adc_buf[i*4 + 4]);
-      crc32_rv_step (adc_buf[i*4 + 5]);
-      v = crc32_rv_get ();
+      int samples = count < ep_left ? count : ep_left;
 
-      ep_fill_wbuf_v (i+2, 1, v);
-    }
+      if (pos == sizeof ep_initial)
+      {
+        memcpy (msg, ep_initial, sizeof ep_initial);
+      }
 
-    adc_start_conversion (0, EP_ROUND_1_INPUTS);
-    tiny_sha2_update(&tiny_sha2_ctx, (unsigned char *)&tiny_sha2_input[0], 64);
+      count -= samples;
+      ep_left -= samples;
+      n = samples / EP_WORD_SAMPLES;
+      if (ep_left == 0)
+      {
+        n--;			/* The last word is for the last byte.  */
+      }
 
-    ep_round++;
+      for (i = 0; i < n; i++, s += EP_WORD_SAMPLES)
+      {
+        ep_filter_word (s);
+        v = crc32_rv_get ();
 
-    return 0;
-  }
-  else if (ep_round == EP_ROUND_1)/* wbuf fill 64 bytes */
-  {
-    for (i = 0; i < EP_ROUND_1_INPUTS / 4; i++)
-    {
-      crc32_rv_step (adc_buf[i*4]);
-      crc32_rv_step (adc_buf[i*4 + 1]);
-      crc32_rv_step (adc_buf[i*4 + 2]);
-      crc32_rv_step (adc_buf[i*4 + 3]);
-      v = crc32_rv_get ();
+        ep_fill_wbuf_v ((msg + pos - (uint8_t *)ep_msg) / 4, 1, v);
+        pos += 4;
+      }
 
-      ep_fill_wbuf_v (i, 1, v);
-    }
+      if (ep_left)
+      {
+        break;
+      }
 
-    adc_start_conversion (0, EP_ROUND_2_INPUTS + 3);
-    tiny_sha2_update(&tiny_sha2_ctx, (unsigned char *)&tiny_sha2_input[0], 64);
+      ep_filter_word (s);
+      s += EP_WORD_SAMPLES;
 
-    ep_round++;
+      v = crc32_rv_get () & 0xff;   /* First byte of CRC32 is used here.  */
+      noise_source_continuous_test (v);
+      msg[pos] = v;
 
-    return 0;
-  }
-  else if (ep_round == EP_ROUND_2)/* wbuf fill (17 + 16 bytes) */
-  {
-    for (i = 0; i < EP_ROUND_2_INPUTS / 4; i++)
+      ep_fill_initial_string (); /* The rest three-byte of CRC32 is used here.  */
+      ep_left = EP_SAMPLES (cond->noise_inputs);
+      pos = sizeof ep_initial;
+      msg += EP_MSG_SIZE;
+      outputs++;
+    }
+
+    ep_pos = pos;
+    ep_start_conversion ();
+    NEUG_TRACE_END (NEUG_TRACE_FILTER);
+
+#ifdef PKG_USING_NEUG_COND_WORKERS
+    /* The outputs in ep_msg are hashed by the workers.  */
+    return outputs * words;
+#else
+    NEUG_TRACE_BEGIN (NEUG_TRACE_CONDITION);
+    if (outputs == 0)
     {
-      crc32_rv_step (adc_buf[i*4]);
-      crc32_rv_step (adc_buf[i*4 + 1]);
-      crc32_rv_step (adc_buf[i*4 + 2]);
-      crc32_rv_step (adc_buf[i*4 + 3]);
-      v = crc32_rv_get ();
+      /* Compute the blocks completed.  */
+      n = (ep_pos / cond->block_size) * cond->block_size;
+      if (n > ep_hashed)
+      {
+        if (ep_hashed == 0)
+        {
+          cond->starts (&cond_ctx);
+        }
 
-      ep_fill_wbuf_v (i, 1, v);
+        cond->update (&cond_ctx, (uint8_t *)ep_msg + ep_hashed, n - ep_hashed);
+        ep_hashed = n;
+      }
+
+      NEUG_TRACE_END (NEUG_TRACE_CONDITION);
+      return 0;
     }
 
-    crc32_rv_step (adc_buf[i*4]);
-    crc32_rv_step (adc_buf[i*4 + 1]);
-    crc32_rv_step (adc_buf[i*4 + 2]);
-    crc32_rv_step (adc_buf[i*4 + 3]);
+    cond_out = dest && outputs * words <= room ? dest : cond_output;
+    msg = (uint8_t *)ep_msg;
+    for (i = 0; i < outputs; i++, msg += EP_MSG_SIZE)
+    {
+      uint8_t *out = (uint8_t *)&cond_out[i * words];
 
-    v = crc32_rv_get () & 0xff;   /* First byte of CRC32 is used here.  */
-    noise_source_continuous_test (v);
-    tiny_sha2_input[i] = v;
+      memcpy (msg + fb_pos, cond_feedback, fb);
 
-    ep_init (NEUG_MODE_CONDITIONED); /* The rest three-byte of CRC32 is used here.  */
+      if (ep_hashed == 0)
+      {
+        cond->starts (&cond_ctx);
+      }
 
-    n = SHA256_DIGEST_SIZE / 2;
-    memcpy (((unsigned char *)&tiny_sha2_input[0]) + EP_ROUND_2_INPUTS, (unsigned char *)&tiny_sha2_output[0], n);
-    tiny_sha2_update(&tiny_sha2_ctx, (unsigned char *)&tiny_sha2_input[0], EP_ROUND_2_INPUTS + n);
-    tiny_sha2_finish(&tiny_sha2_ctx, (unsigned char *)&tiny_sha2_output[0]);
+      cond->update (&cond_ctx, msg + ep_hashed, fb_pos + fb - ep_hashed);
+      cond->finish (&cond_ctx, out);
+      ep_hashed = 0;
+      memcpy (cond_feedback, out, fb);
+    }
 
-    return SHA256_DIGEST_SIZE / sizeof (uint32_t);
+    NEUG_TRACE_END (NEUG_TRACE_CONDITION);
+    return outputs * words;
+#endif
   }
   else if (ep_round == EP_ROUND_RAW)
   {
+    NEUG_TRACE_BEGIN (NEUG_TRACE_FILTER);
     for (i = 0; i < EP_ROUND_RAW_INPUTS / 4; i++)
     {
-      crc32_rv_step (adc_buf[i*4]);
-      crc32_rv_step (adc_buf[i*4 + 1]);
-      crc32_rv_step (adc_buf[i*4 + 2]);
-      crc32_rv_step (adc_buf[i*4 + 3]);
+      ep_filter_word (&adc_buf[i * EP_WORD_SAMPLES]);
       v = crc32_rv_get ();
       ep_fill_wbuf_v (i, 1, v);
     }
+    NEUG_TRACE_END (NEUG_TRACE_FILTER);
 
     ep_init (mode);
 
@@ -341,17 +610,49 @@ static const uint32_t *ep_output (int mode)
 {
   if (mode)
   {
-    return &tiny_sha2_input[0];
+    return &ep_msg[0];
   }
   else
   {
-    return &tiny_sha2_output[0];
+    return cond_out;
+  }
+}
+
+/*
+ * Return 1 when the conversion in progress completes an output of
+ * conditioned data.
+ */
+static int ep_will_output (void)
+{
+#ifdef PKG_USING_NEUG_COND_WORKERS
+  return 0;			/* It's computed by the workers.  */
+#else
+  return ep_round == EP_ROUND_CONDITIONED && ep_count >= ep_left;
+#endif
+}
+
+#ifdef PKG_USING_NEUG_RAW_TAP
+/* Return the number of samples of the conversion completed.  */
+static int ep_conversion_size (void)
+{
+  if (ep_round == EP_ROUND_RAW)
+  {
+    return EP_SAMPLES (EP_ROUND_RAW_INPUTS);
   }
+  else if (ep_round == EP_ROUND_RAW_DATA)
+  {
+    return EP_ROUND_RAW_DATA_INPUTS / 4;
+  }
+
+  return ep_count;
 }
+#endif
 
 #define REPETITION_COUNT           1
 #define ADAPTIVE_PROPORTION_64     2
 #define ADAPTIVE_PROPORTION_4096   4
+#define OUTPUT_STUCK_BLOCK         8
+#define OUTPUT_STATISTICAL        16
 
 uint8_t neug_err_state;
 
@@ -359,15 +660,35 @@ uint16_t neug_err_cnt;
 uint16_t neug_err_cnt_rc;
 uint16_t neug_err_cnt_p64;
 uint16_t neug_err_cnt_p4k;
+#ifdef PKG_USING_NEUG_OUTPUT_MONITOR
+uint16_t neug_err_cnt_stuck;
+uint16_t neug_err_cnt_stat;
+#endif
 
 uint16_t neug_rc_max;
 uint16_t neug_p64_max;
 uint16_t neug_p4k_max;
 
+uint32_t neug_out_cnt;		/* Words of output, published */
+uint32_t neug_discard_cnt;	/* Words of output, discarded by errors */
+
 static void noise_source_cnt_max_reset (void)
 {
   neug_err_cnt = neug_err_cnt_rc = neug_err_cnt_p64 = neug_err_cnt_p4k = 0;
   neug_rc_max = neug_p64_max = neug_p4k_max = 0;
+#ifdef PKG_USING_NEUG_OUTPUT_MONITOR
+  neug_err_cnt_stuck = neug_err_cnt_stat = 0;
+#endif
+}
+
+/**
+ * @brief  Reset the error counters, the maximum counts of the health
+ *         tests, and the output counters, for measurement.
+ */
+void neug_stat_reset (void)
+{
+  noise_source_cnt_max_reset ();
+  neug_out_cnt = neug_discard_cnt = 0;
 }
 
 static void noise_source_error_reset (void)
@@ -375,9 +696,9 @@ static void noise_source_error_reset (void)
   neug_err_state = 0;
 }
 
-static void noise_source_error (uint32_t err)
+/* Count the errors ERR, without discarding the output.  */
+static void noise_source_error_count (uint32_t err)
 {
-  neug_err_state |= err;
   neug_err_cnt++;
 
   if ((err & REPETITION_COUNT))
@@ -394,6 +715,24 @@ static void noise_source_error (uint32_t err)
   {
     neug_err_cnt_p4k++;
   }
+
+#ifdef PKG_USING_NEUG_OUTPUT_MONITOR
+  if ((err & OUTPUT_STUCK_BLOCK))
+  {
+    neug_err_cnt_stuck++;
+  }
+
+  if ((err & OUTPUT_STATISTICAL))
+  {
+    neug_err_cnt_stat++;
+  }
+#endif
+}
+
+static void noise_source_error (uint32_t err)
+{
+  neug_err_state |= err;
+  noise_source_error_count (err);
 }
 
 /*
@@ -665,301 +1004,2940 @@ static void noise_source_continuous_test_word (uint8_t b0, uint8_t b1,
   adaptive_proportion_4096_test_word (b0, b1, b2, b3);
 }
 
-#define RNG_SPACE_AVAILABLE   0x01
-#define RNG_DATA_AVAILABLE   0x02
-
-#define RNG_ALL_STATE (RNG_DATA_AVAILABLE|RNG_SPACE_AVAILABLE)
-
+#ifdef PKG_USING_NEUG_OUTPUT_MONITOR
 /*
- * Ring buffer, filled by generator, consumed by neug_get routine.
+ * Continuous monitor of the conditioned output.
+ *
+ * The health tests above only see the CRC-32 filtered noise.  When
+ * something goes wrong after that (conditioning, memory, ...), the
+ * output may be broken while the noise is fine.  This monitor runs the
+ * statistical tests of FIPS 140-2 (monobit, poker, runs and long run,
+ * with the bounds of Change Notice 1) on consecutive 20000-bit windows
+ * of output, and compares each block with the previous one (stuck
+ * block, the continuous RNG test of FIPS 140-2 4.9.2).
+ *
+ * All statistics are updated incrementally, one word at a time, so
+ * that the cost is spread evenly over every block: a popcount for the
+ * monobit test, a nibble histogram for the poker test, and the runs
+ * are scanned with count-trailing-zeros, one step per run instead of
+ * one step per bit.  Bits are taken from LSB to MSB of each word.
+ *
+ * A failure of the window tests is detected at the end of the window
+ * and the block at hand is discarded; it is meant to catch a
+ * catastrophic failure, not to judge the quality of each block.
  */
-struct rng_rb {
-  uint32_t *buf;
-  struct rt_mutex m;
-  struct rt_event available_state;
-  uint8_t head, tail;
-  uint8_t size;
-  unsigned int full :1;
-  unsigned int empty :1;
-};
+#define OUTPUT_MONITOR_WINDOW_BITS  20000
+#define OUTPUT_MONITOR_LONG_RUN     26
+
+#if defined(__GNUC__)
+#define om_popcount(x) __builtin_popcount (x)
+#define om_ctz(x)      __builtin_ctz (x)
+#else
+static int om_popcount (uint32_t x)
+{
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  x = (x + (x >> 4)) & 0x0f0f0f0f;
+  return (x * 0x01010101) >> 24;
+}
 
-static void rb_init (struct rng_rb *rb, uint32_t *p, uint8_t size)
+static int om_ctz (uint32_t x)
 {
-  rb->buf = p;
-  rb->size = size;
-  rt_mutex_init(&rb->m, "rng_rb_m", RT_IPC_FLAG_FIFO);
-  rt_event_init(&rb->available_state, "rng_rb_s", RT_IPC_FLAG_FIFO);
-  rb->head = rb->tail = 0;
-  rb->full = 0;
-  rb->empty = 1;
+  return om_popcount ((x & -x) - 1);
 }
+#endif
 
-static void rb_add (struct rng_rb *rb, uint32_t v)
+static const uint16_t om_runs_min[6] = { 2315, 1114, 527, 240, 103, 103 };
+static const uint16_t om_runs_max[6] = { 2685, 1386, 723, 384, 209, 209 };
+
+static uint16_t om_bits;        /* bits in the window so far */
+static uint16_t om_ones;
+static uint16_t om_poker[16];
+static uint16_t om_runs[2][6];  /* runs of 0 and 1, length 1..6+ */
+static uint8_t om_long_run;
+static uint8_t om_run_bit;
+static uint16_t om_run_len;
+
+static uint32_t om_last[NEUG_COND_DIGEST_MAX/sizeof (uint32_t)];
+static uint8_t om_last_valid;
+
+static void output_monitor_window_reset (void)
 {
-  rb->buf[rb->tail++] = v;
+  om_bits = om_ones = 0;
+  memset (om_poker, 0, sizeof om_poker);
+  memset (om_runs, 0, sizeof om_runs);
+  om_long_run = 0;
+  om_run_bit = 0;
+  om_run_len = 0;
+}
 
-  if (rb->tail == rb->size)
+static void output_monitor_reset (void)
+{
+  output_monitor_window_reset ();
+  om_last_valid = 0;
+}
+
+static void output_monitor_run_end (void)
+{
+  if (om_run_len == 0)
   {
-    rb->tail = 0;
+    return;
   }
 
-  if (rb->tail == rb->head)
+  if (om_run_len >= OUTPUT_MONITOR_LONG_RUN)
   {
-    rb->full = 1;
+    om_long_run = 1;
   }
 
-  rb->empty = 0;
+  om_runs[om_run_bit][(om_run_len > 6 ? 6 : om_run_len) - 1]++;
 }
 
-static uint32_t rb_del (struct rng_rb *rb)
+static void output_monitor_word (uint32_t v, int nbits)
 {
-  uint32_t v = rb->buf[rb->head++];
+  uint32_t x;
+  int p = 0;
+  int i;
 
-  if (rb->head == rb->size)
+  if (nbits < 32)
   {
-    rb->head = 0;
+    v &= (1UL << nbits) - 1;
   }
 
-  if (rb->head == rb->tail)
+  om_ones += om_popcount (v);
+
+  for (i = 0; i < nbits; i += 4)
   {
-    rb->empty = 1;
+    om_poker[(v >> i) & 0x0f]++;
   }
 
-  rb->full = 0;
+  /* Scan the runs: find the first bit which differs from the run.  */
+  while (p < nbits)
+  {
+    x = (om_run_bit ? ~v : v) >> p;
+    if (nbits < 32)
+    {
+      x &= (1UL << (nbits - p)) - 1;
+    }
 
-  return v;
-}
+    if (x == 0)
+    {
+      om_run_len += nbits - p;
+      break;
+    }
 
-uint8_t neug_mode;
-static int rng_should_terminate;
-static rt_thread_t rng_thread;
+    i = om_ctz (x);
+    om_run_len += i;
+    p += i;
+    output_monitor_run_end ();
+    om_run_bit ^= 1;
+    om_run_len = 0;
+  }
+}
 
-/**
- * @brief Random number generation thread.
- */
-static void rng (void* parameter)
+static int output_monitor_window_check (void)
 {
-  struct rng_rb *rb = (struct rng_rb *)parameter;
-  int mode = neug_mode;
+  uint32_t sum = 0;
+  int i;
 
-  rng_should_terminate = 0;
-  rt_mutex_init(&mode_mtx, "rng_mode", RT_IPC_FLAG_FIFO);
-  rt_event_init(&mode_cond, "rng_mode", RT_IPC_FLAG_FIFO);
+  output_monitor_run_end ();
 
-  /* Init ADCs */
-  adc_init();
+  /* Monobit: 9725 < X < 10275 */
+  if (om_ones <= 9725 || om_ones >= 10275)
+  {
+    return -1;
+  }
 
-  /* Enable ADCs */
-  adc_start ();
+  /* Poker: 2.16 < X < 46.17, where X = 16/5000 * sum(f^2) - 5000 */
+  for (i = 0; i < 16; i++)
+  {
+    sum += (uint32_t)om_poker[i] * om_poker[i];
+  }
 
-  ep_init (mode);
+  sum = sum * 16 - 25000000;
+  if (sum <= 10800 || sum >= 230850)
+  {
+    return -1;
+  }
 
-  while (!rng_should_terminate)
+  /* Runs and long run */
+  for (i = 0; i < 6; i++)
   {
-    int err;
-    int n;
+    if (om_runs[0][i] < om_runs_min[i] || om_runs[0][i] > om_runs_max[i]
+        || om_runs[1][i] < om_runs_min[i] || om_runs[1][i] > om_runs_max[i])
+    {
+      return -1;
+    }
+  }
 
-    /* return 0 on success. */
-    err = adc_wait_completion ();
+  if (om_long_run)
+  {
+    return -1;
+  }
 
-    rt_mutex_take(&mode_mtx, RT_WAITING_FOREVER);
-    /* if err occur or mode change */
-    if (err || mode != neug_mode)
-    {
-      mode = neug_mode;
+  return 0;
+}
 
-      noise_source_cnt_max_reset ();
+/*
+ * Return the errors found, OUTPUT_STUCK_BLOCK or OUTPUT_STATISTICAL.
+ * Those are not counted here, as the conditioning workers call this.
+ */
+static uint32_t output_monitor_test (const uint32_t *vp, int n)
+{
+  int words = cond->digest_size / sizeof (uint32_t);
+  uint32_t err = 0;
+  int i;
 
-      /* Discarding data available, re-initiate from the start.  */
-      ep_init (mode);
+  for (i = 0; i < n; i += words)
+  {
+    if (om_last_valid && !memcmp (om_last, vp + i, words * sizeof (uint32_t)))
+    {
+      err |= OUTPUT_STUCK_BLOCK;
+    }
 
-      rt_mutex_release(&mode_mtx);
+    memcpy (om_last, vp + i, words * sizeof (uint32_t));
+    om_last_valid = 1;
+  }
 
-      /* notify mode condition event */
-      rt_event_send(&mode_cond, MODE_CONDITION);
+  for (i = 0; i < n; i++)
+  {
+    int nbits = OUTPUT_MONITOR_WINDOW_BITS - om_bits;
 
-      continue;
-    }
-    else
+    if (nbits > 32)
     {
-      rt_mutex_release(&mode_mtx);
+      nbits = 32;
     }
 
-    if ((n = ep_process (mode)) > 0)
-    {
-      int i;
-      const uint32_t *vp;
+    output_monitor_word (vp[i], nbits);
+    om_bits += nbits;
 
-      /* noise err */
-      if (neug_err_state != 0 && 
-        (mode == NEUG_MODE_CONDITIONED || mode == NEUG_MODE_RAW))
+    if (om_bits == OUTPUT_MONITOR_WINDOW_BITS)
+    {
+      if (output_monitor_window_check () < 0)
       {
-        /* Don't use the result and do it again.  */
-        noise_source_error_reset ();
-        continue;
+        err |= OUTPUT_STATISTICAL;
       }
 
-      vp = ep_output (mode);
+      /* The rest of the word starts next window.  */
+      output_monitor_window_reset ();
 
-      rt_mutex_take(&rb->m, RT_WAITING_FOREVER);
-      while (rb->full)
+      if (nbits < 32)
       {
-        rt_mutex_release(&rb->m);
-
-        /* wait until space available event */
-        rt_event_recv(&rb->available_state, RNG_SPACE_AVAILABLE, 
-            RT_EVENT_FLAG_AND|RT_EVENT_FLAG_CLEAR, RT_WAITING_FOREVER, NULL);
-
-        rt_mutex_take(&rb->m, RT_WAITING_FOREVER);
+        output_monitor_word (vp[i] >> nbits, 32 - nbits);
+        om_bits = 32 - nbits;
       }
+    }
+  }
 
-      for (i = 0; i < n; i++)
+  return err;
+}
+#endif
+
+#define RNG_SPACE_AVAILABLE   0x01
+#define RNG_DATA_AVAILABLE   0x02
+#define RNG_READY            0x04
+#define RNG_DATA_PRIO(p)     (0x10 << (p))	/* for each class */
+
+/*
+ * Words in the ring buffer, which only NEUG_PRIO_URGENT consumers can
+ * take.
+ */
+#ifndef NEUG_PRIO_RESERVE
+#define NEUG_PRIO_RESERVE 2
+#endif
+
+#define RNG_ALL_STATE (RNG_DATA_AVAILABLE|RNG_SPACE_AVAILABLE)
+
+/*
+ * The ring buffer is split into shards, one for each CPU, so that
+ * consumers on different CPUs don't contend for a mutex.  A consumer
+ * takes from the shard of its CPU, and from other shards only when
+ * it's empty.
+ */
+#ifndef NEUG_SHARDS
+#if defined(RT_USING_SMP) && !defined(PKG_USING_NEUG_PULL)
+#define NEUG_SHARDS RT_CPUS_NR
+#else
+#define NEUG_SHARDS 1
+#endif
+#endif
+
+/*
+ * Minimum words of a shard.  A smaller one has few words over the
+ * reserve, and its consumers would wait at almost every read.  When
+ * the buffer is not large enough, fewer shards are used.
+ */
+#ifndef NEUG_SHARD_MIN
+#define NEUG_SHARD_MIN 8
+#endif
+
+#if NEUG_SHARD_MIN <= NEUG_PRIO_RESERVE
+#error "NEUG_SHARD_MIN must be larger than NEUG_PRIO_RESERVE"
+#endif
+
+/*
+ * Ring buffer (a shard), filled by generator, consumed by neug_get
+ * routine.  RNG_DATA_AVAILABLE and RNG_DATA_PRIO are sent to
+ * available_state of the shard, RNG_SPACE_AVAILABLE and RNG_READY to
+ * rng_state.
+ */
+struct rng_rb {
+  uint32_t *buf;
+#ifndef PKG_USING_NEUG_PULL
+  struct rt_mutex m;
+  struct rt_event available_state;
+#endif
+  uint8_t head, tail;
+  uint8_t size;
+  uint8_t reserve;
+  uint8_t waiting[NEUG_PRIO_NUM];
+  rt_thread_t peeker;		/* Consumer with words peeked */
+  uint8_t peeked;		/* Words at head, peeked by PEEKER */
+  uint8_t skipped;		/* Words after them, taken meanwhile */
+  unsigned int full :1;
+  unsigned int empty :1;
+  uint32_t added;		/* Words added by the generator */
+  uint32_t taken;		/* Words taken by consumers */
+  uint32_t stolen;		/* Words taken by consumers of other shards */
+};
+
+static void rb_init (struct rng_rb *rb, uint32_t *p, uint8_t size)
+{
+  rb->buf = p;
+  rb->size = size;
+#ifndef PKG_USING_NEUG_PULL
+  rt_mutex_init(&rb->m, "rng_rb_m", RT_IPC_FLAG_FIFO);
+  rt_event_init(&rb->available_state, "rng_rb_s", RT_IPC_FLAG_FIFO);
+#endif
+  rb->head = rb->tail = 0;
+  rb->full = 0;
+  rb->empty = 1;
+  rb->reserve = NEUG_PRIO_RESERVE < size ? NEUG_PRIO_RESERVE : size / 2;
+  memset (rb->waiting, 0, sizeof rb->waiting);
+  rb->added = rb->taken = rb->stolen = 0;
+  rb->peeker = RT_NULL;
+  rb->peeked = rb->skipped = 0;
+}
+
+static void rb_add (struct rng_rb *rb, uint32_t v)
+{
+  rb->buf[rb->tail++] = v;
+
+  if (rb->tail == rb->size)
+  {
+    rb->tail = 0;
+  }
+
+  if (rb->tail == rb->head)
+  {
+    rb->full = 1;
+  }
+
+  rb->empty = 0;
+  rb->added++;
+}
+
+static uint32_t rb_del (struct rng_rb *rb)
+{
+  uint32_t v;
+
+  if (rb->peeked)
+  {
+    /* Skip the peeked words, their space is released by neug_commit.  */
+    v = rb->buf[(rb->head + rb->peeked + rb->skipped++) % rb->size];
+    rb->taken++;
+    return v;
+  }
+
+  v = rb->buf[rb->head++];
+
+  if (rb->head == rb->size)
+  {
+    rb->head = 0;
+  }
+
+  if (rb->head == rb->tail)
+  {
+    rb->empty = 1;
+  }
+
+  rb->full = 0;
+  rb->taken++;
+
+  return v;
+}
+
+/*
+ * Return the free space at the tail, contiguous, for the generator to
+ * write output directly, and set *N to its size in words.  Words
+ * between tail and head are not touched by consumers, so it can be
+ * written without the lock.
+ */
+static uint32_t *rb_space (struct rng_rb *rb, int *n)
+{
+  if (rb->full)
+  {
+    *n = 0;
+    return RT_NULL;
+  }
+
+  if (rb->empty)
+  {
+    rb->head = rb->tail = 0;
+  }
+
+  *n = (rb->tail < rb->head ? rb->head : rb->size) - rb->tail;
+  return &rb->buf[rb->tail];
+}
+
+/*
+ * Add N words, written in the space by rb_space.
+ */
+static void rb_advance (struct rng_rb *rb, int n)
+{
+  rb->tail = (rb->tail + n) % rb->size;
+
+  if (rb->tail == rb->head)
+  {
+    rb->full = 1;
+  }
+
+  rb->empty = 0;
+  rb->added += n;
+}
+
+static int rb_count (struct rng_rb *rb)
+{
+  if (rb->full)
+  {
+    return rb->size;
+  }
+
+  return (rb->tail + rb->size - rb->head) % rb->size;
+}
+
+/*
+ * Return the words consumers can take, not peeked nor skipped.
+ */
+static int rb_avail (struct rng_rb *rb)
+{
+  return rb_count (rb) - rb->peeked - rb->skipped;
+}
+
+/*
+ * Return 1 when a consumer of class PRIO can take a word now: there is
+ * no waiting consumer of higher class, and it doesn't touch the
+ * reserve (unless it's NEUG_PRIO_URGENT).  Peeked words are not
+ * counted, the words after them can be taken.
+ */
+static int rb_may_take (struct rng_rb *rb, int prio)
+{
+  int i;
+
+  if (rb_avail (rb) == 0)
+  {
+    return 0;
+  }
+
+  for (i = prio + 1; i < NEUG_PRIO_NUM; i++)
+  {
+    if (rb->waiting[i])
+    {
+      return 0;
+    }
+  }
+
+  if (prio < NEUG_PRIO_URGENT && rb_avail (rb) <= rb->reserve)
+  {
+    return 0;
+  }
+
+  return 1;
+}
+
+/*
+ * Wake up the waiting consumers of the highest class, if they can take
+ * a word.  Called with rb->m held, when data is added, or when a
+ * consumer leaves data in the ring buffer.
+ */
+static void rb_wakeup (struct rng_rb *rb)
+{
+  int i;
+
+  for (i = NEUG_PRIO_NUM - 1; i >= 0; i--)
+  {
+    if (rb->waiting[i])
+    {
+      if (rb_may_take (rb, i))
+      {
+        RNG_SEND (&rb->available_state, RNG_DATA_PRIO (i));
+      }
+
+      break;
+    }
+  }
+}
+
+static struct rng_rb the_ring_buffer[NEUG_SHARDS];
+static int rng_shards;		/* Shards in use */
+#ifndef PKG_USING_NEUG_PULL
+static struct rt_event rng_state;
+#endif
+
+/*
+ * Return the shard of the CPU running the caller.
+ */
+static struct rng_rb *rb_local (void)
+{
+#if NEUG_SHARDS > 1
+#if defined(RT_USING_SMP)
+  int cpu = rt_hw_cpu_id ();
+#elif defined(__linux__)
+  int cpu = sched_getcpu ();
+#else
+  int cpu = 0;
+#endif
+
+  if (cpu < 0)
+  {
+    cpu = 0;
+  }
+
+  return &the_ring_buffer[cpu % rng_shards];
+#else
+  return &the_ring_buffer[0];
+#endif
+}
+
+/*
+ * Take a word for a consumer of class PRIO from other shards than
+ * LOCAL.  Return 0 on success, -1 when all are empty.
+ */
+static int rb_steal (struct rng_rb *local, int prio, uint32_t *p)
+{
+  int i, j = local - the_ring_buffer;
+
+  for (i = 1; i < rng_shards; i++)
+  {
+    struct rng_rb *rb = &the_ring_buffer[(j + i) % rng_shards];
+
+    RNG_LOCK (&rb->m);
+    if (rb_may_take (rb, prio))
+    {
+      *p = rb_del (rb);
+      rb->stolen++;
+      rb_wakeup (rb);
+      RNG_UNLOCK (&rb->m);
+      return 0;
+    }
+
+    RNG_UNLOCK (&rb->m);
+  }
+
+  return -1;
+}
+
+/*
+ * Select the shard to be filled next, after CUR.  A shard with
+ * waiting consumers comes first, then, next one which is not full.
+ * Return RT_NULL when all shards are full.  It's only a hint, as it
+ * looks the shards without the lock.
+ */
+static struct rng_rb *rng_shard_pick (struct rng_rb *cur)
+{
+  struct rng_rb *next = RT_NULL;
+  int i, j = cur - the_ring_buffer;
+
+  for (i = 1; i <= rng_shards; i++)
+  {
+    struct rng_rb *rb = &the_ring_buffer[(j + i) % rng_shards];
+    int prio;
+
+    if (rb->full)
+    {
+      continue;
+    }
+
+    for (prio = 0; prio < NEUG_PRIO_NUM; prio++)
+    {
+      if (rb->waiting[prio])
+      {
+        return rb;
+      }
+    }
+
+    if (next == RT_NULL)
+    {
+      next = rb;
+    }
+  }
+
+  return next;
+}
+
+/*
+ * Min-entropy of a noise input (a byte of CRC-32 output), in 1/100
+ * bit.  It's the assumption of the health tests, see below.
+ */
+#ifndef NEUG_MIN_ENTROPY
+#define NEUG_MIN_ENTROPY 420
+#endif
+
+#define WORD_FULL_ENTROPY (32 * 100)
+
+/*
+ * Return the entropy credited to a word of output in MODE, in 1/100
+ * bit.  Following the requirement for N, an output of conditioned
+ * data has full entropy when the noise inputs have twice of the
+ * output size, otherwise half of the input is credited.  In
+ * NEUG_MODE_RAW, a word is four noise inputs.  Nothing is credited to
+ * sample data, which is not tested.
+ */
+static uint16_t rng_word_credit (int mode)
+{
+  uint32_t h_in, h_out;
+
+  if (mode == NEUG_MODE_CONDITIONED)
+  {
+    h_in = cond->noise_inputs * NEUG_MIN_ENTROPY;
+    h_out = cond->digest_size * 8 * 100;
+    if (h_in < h_out * 2)
+    {
+      h_out = h_in / 2;
+    }
+
+    return h_out / (cond->digest_size / sizeof (uint32_t));
+  }
+  else if (mode == NEUG_MODE_RAW)
+  {
+    return 4 * NEUG_MIN_ENTROPY;
+  }
+
+  return 0;
+}
+
+static uint16_t rng_credit;	/* Entropy of a word, in 1/100 bit */
+
+uint8_t neug_mode;
+static int rng_started;
+#ifndef PKG_USING_NEUG_PULL
+static int rng_should_terminate;
+static rt_thread_t rng_thread;
+#endif
+#ifdef PKG_USING_NEUG_COND_WORKERS
+static rt_thread_t cond_threads[NEUG_COND_WORKERS];
+static volatile int cond_flushing;	/* Outputs are dropped */
+#endif
+
+/*
+ * Warm-up: the first NEUG_PRE_LOOP words of output are discarded by
+ * the rng thread itself, so that neug_init doesn't need to wait.
+ * Consumers arriving before that just wait for data as usual.
+ */
+static int rng_warmup;
+static volatile int rng_ready;
+
+#ifdef PKG_USING_NEUG_SEED_FILE
+/*
+ * An output of conditioned data goes to the seed file, every
+ * NEUG_SEED_SAVE_INTERVAL ticks.  The file I/O is not done on the
+ * stack of the rng thread: the output is handed to the system work
+ * queue.  Without it, the stack of the rng thread is enlarged by
+ * NEUG_SEED_STACK for the write: DFS resolves the path into a buffer
+ * of DFS_PATH_MAX (256) bytes, and FatFs with LFN on stack has a name
+ * buffer of (FF_MAX_LFN + 1) * 2 (512) bytes, in nested calls of open,
+ * fsync and rename.
+ */
+#ifndef NEUG_SEED_SAVE_INTERVAL
+#define NEUG_SEED_SAVE_INTERVAL (RT_TICK_PER_SECOND * 600)
+#endif
+
+static rt_tick_t rng_seed_tick;
+#if defined(RT_USING_SYSTEM_WORKQUEUE) && !defined(PKG_USING_NEUG_PULL)
+#define NEUG_SEED_WORK
+static struct rt_work rng_seed_work;
+static uint8_t rng_seed_buf[NEUG_SEED_SIZE];
+static volatile uint8_t rng_seed_busy;	/* Being written by the work */
+#elif !defined(NEUG_SEED_STACK)
+#define NEUG_SEED_STACK 2048
+#endif
+#endif
+
+#ifndef NEUG_SEED_STACK
+#define NEUG_SEED_STACK 0
+#endif
+
+/*
+ * Priority boost: while consumers are blocked for data, the rng thread
+ * runs at the priority of the highest of them, so that threads of
+ * middle priority can't starve them through the event.  It's back to
+ * NEUG_RNG_PRIORITY when they are served.  RNG_BOOST_CNT counts the
+ * blocked consumers for each priority.
+ */
+#ifndef PKG_USING_NEUG_PULL
+#ifndef NEUG_RNG_PRIORITY
+#define NEUG_RNG_PRIORITY (RT_THREAD_PRIORITY_MAX - 2)
+#endif
+
+static struct rt_mutex rng_boost_m;
+static uint16_t rng_boost_cnt[NEUG_RNG_PRIORITY];
+static rt_uint8_t rng_prio;
+
+static void rng_boost_update (void)
+{
+  rt_uint8_t prio;
+
+  for (prio = 0; prio < NEUG_RNG_PRIORITY; prio++)
+  {
+    if (rng_boost_cnt[prio])
+    {
+      break;
+    }
+  }
+
+  if (prio != rng_prio && rng_thread != RT_NULL)
+  {
+#ifdef PKG_USING_NEUG_COND_WORKERS
+    int i;
+
+    for (i = 0; i < NEUG_COND_WORKERS; i++)
+    {
+      if (cond_threads[i] != RT_NULL)
+      {
+        rt_thread_control(cond_threads[i], RT_THREAD_CTRL_CHANGE_PRIORITY,
+                          &prio);
+      }
+    }
+#endif
+    rng_prio = prio;
+    rt_thread_control(rng_thread, RT_THREAD_CTRL_CHANGE_PRIORITY, &prio);
+  }
+}
+
+/*
+ * Called by a consumer before it blocks for data.  Return the priority
+ * counted, which must be passed to rng_boost_leave (the priority of
+ * the caller may change in between, by priority inheritance).
+ */
+static rt_uint8_t rng_boost_enter (void)
+{
+  rt_uint8_t prio = rt_thread_self ()->current_priority;
+
+  if (prio < NEUG_RNG_PRIORITY)
+  {
+    rt_mutex_take(&rng_boost_m, RT_WAITING_FOREVER);
+    rng_boost_cnt[prio]++;
+    rng_boost_update ();
+    rt_mutex_release(&rng_boost_m);
+  }
+
+  return prio;
+}
+
+static void rng_boost_leave (rt_uint8_t prio)
+{
+  if (prio < NEUG_RNG_PRIORITY)
+  {
+    rt_mutex_take(&rng_boost_m, RT_WAITING_FOREVER);
+    rng_boost_cnt[prio]--;
+    rng_boost_update ();
+    rt_mutex_release(&rng_boost_m);
+  }
+}
+#endif
+
+#ifdef PKG_USING_NEUG_DIRECT_FILL
+/*
+ * Direct fill: a consumer of NEUG_DIRECT_MIN words or more registers
+ * its buffer as a request, and the generator writes outputs into it,
+ * instead of the ring buffer.  An output is computed in the buffer
+ * in place when it fits, and the consumer is woken up once, when the
+ * request is done.  Requests are served in order, but the ring buffer
+ * comes first while consumers wait for it.
+ */
+#ifndef NEUG_DIRECT_MIN
+#define NEUG_DIRECT_MIN 32
+#endif
+
+struct rng_req {
+  struct rng_req *next;
+  uint32_t *p;			/* Next word to be written */
+  int n;			/* Words left */
+#ifndef PKG_USING_NEUG_PULL
+  struct rt_semaphore done;
+#endif
+};
+
+static struct rng_req *rng_req_head, *rng_req_tail;
+#ifndef PKG_USING_NEUG_PULL
+static struct rt_mutex rng_req_m;
+#else
+static void rng_step (void);
+#endif
+
+static int rng_consumer_waiting (void)
+{
+  int i, j;
+
+  for (i = 0; i < rng_shards; i++)
+  {
+    for (j = 0; j < NEUG_PRIO_NUM; j++)
+    {
+      if (the_ring_buffer[i].waiting[j])
+      {
+        return 1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * Return the buffer of the first request for the output to be written
+ * in place, and set *ROOM to its size in words.
+ */
+static uint32_t *rng_req_space (int *room)
+{
+  uint32_t *p = RT_NULL;
+
+  RNG_LOCK (&rng_req_m);
+  if (rng_req_head != RT_NULL && !rng_consumer_waiting ())
+  {
+    p = rng_req_head->p;
+    *room = rng_req_head->n;
+  }
+  RNG_UNLOCK (&rng_req_m);
+
+  return p;
+}
+
+/*
+ * Put up to N words at VP into the requests, and return the number of
+ * words taken.  When VP is the buffer of the request, they are there
+ * already.
+ */
+static int rng_req_put (const uint32_t *vp, int n)
+{
+  int k = 0;
+
+  RNG_LOCK (&rng_req_m);
+  while (k < n && rng_req_head != RT_NULL && !rng_consumer_waiting ())
+  {
+    struct rng_req *req = rng_req_head;
+    int m = n - k < req->n ? n - k : req->n;
+
+    if (req->p != vp + k)
+    {
+      memcpy (req->p, vp + k, m * sizeof (uint32_t));
+    }
+
+    req->p += m;
+    req->n -= m;
+    k += m;
+
+    if (req->n == 0)
+    {
+      if ((rng_req_head = req->next) == RT_NULL)
+      {
+        rng_req_tail = RT_NULL;
+      }
+
+#ifndef PKG_USING_NEUG_PULL
+      /* REQ may be gone after this.  */
+      rt_sem_release(&req->done);
+#endif
+    }
+  }
+  RNG_UNLOCK (&rng_req_m);
+
+  neug_out_cnt += k;
+  return k;
+}
+
+static void rng_req_add (struct rng_req *req)
+{
+  RNG_LOCK (&rng_req_m);
+  if (rng_req_tail != RT_NULL)
+  {
+    rng_req_tail->next = req;
+  }
+  else
+  {
+    rng_req_head = req;
+  }
+  rng_req_tail = req;
+  RNG_UNLOCK (&rng_req_m);
+}
+
+/*
+ * Let the generator write N words into P, and wait for it.
+ */
+static void rng_req_wait (uint32_t *p, int n)
+{
+  struct rng_req req;
+#ifndef PKG_USING_NEUG_PULL
+  rt_uint8_t boost;
+#endif
+
+  req.next = RT_NULL;
+  req.p = p;
+  req.n = n;
+#ifndef PKG_USING_NEUG_PULL
+  rt_sem_init(&req.done, "rng_req", 0, RT_IPC_FLAG_FIFO);
+#endif
+
+  rng_req_add (&req);
+
+#ifdef PKG_USING_NEUG_PULL
+  while (req.n > 0)
+  {
+    rng_step ();
+  }
+#else
+  /* The generator may wait for space in the ring buffer.  */
+  RNG_SEND (&rng_state, RNG_SPACE_AVAILABLE);
+
+  NEUG_TRACE_BEGIN (NEUG_TRACE_CONSUMER);
+  boost = rng_boost_enter ();
+  rt_sem_take(&req.done, RT_WAITING_FOREVER);
+  rng_boost_leave (boost);
+  NEUG_TRACE_END (NEUG_TRACE_CONSUMER);
+  rt_sem_detach(&req.done);
+#endif
+}
+#endif
+
+#ifdef PKG_USING_NEUG_ADC_DUTY_CYCLE
+/*
+ * Duty cycling of the ADC: when the ring buffer stays full for
+ * RNG_IDLE ticks, the ADC is stopped, and it's started again when the
+ * occupancy goes down to NEUG_ADC_REFILL percent, or a consumer waits.
+ *
+ * RNG_IDLE adapts to consumers: when the ADC is started again within
+ * NEUG_ADC_BREAK_EVEN ticks after the stop, stopping didn't pay for
+ * the restart, and it's doubled; otherwise it's halved.
+ */
+#ifndef NEUG_ADC_IDLE
+#define NEUG_ADC_IDLE (RT_TICK_PER_SECOND / 10)
+#endif
+
+#ifndef NEUG_ADC_IDLE_MIN
+#define NEUG_ADC_IDLE_MIN (RT_TICK_PER_SECOND / 100 + 1)
+#endif
+
+#ifndef NEUG_ADC_IDLE_MAX
+#define NEUG_ADC_IDLE_MAX (RT_TICK_PER_SECOND * 10)
+#endif
+
+#ifndef NEUG_ADC_BREAK_EVEN
+#define NEUG_ADC_BREAK_EVEN (RT_TICK_PER_SECOND / 2)
+#endif
+
+#ifndef NEUG_ADC_REFILL
+#define NEUG_ADC_REFILL 50
+#endif
+
+static rt_tick_t rng_idle;
+static int rng_adc_stopped;
+static int rng_adc_measure;
+static rt_tick_t rng_adc_tick;	/* of the last stop, or start */
+static struct neug_duty_info rng_duty;
+
+/*
+ * Return the occupancy of the ring buffer in percent, or 0 when a
+ * consumer waits.
+ */
+static int rng_level (void)
+{
+  int i, j, count = 0, size = 0;
+
+#ifdef PKG_USING_NEUG_DIRECT_FILL
+  if (rng_req_head != RT_NULL)
+  {
+    return 0;			/* A request waits for data.  */
+  }
+#endif
+
+  for (i = 0; i < rng_shards; i++)
+  {
+    struct rng_rb *rb = &the_ring_buffer[i];
+
+    RNG_LOCK (&rb->m);
+    for (j = 0; j < NEUG_PRIO_NUM; j++)
+    {
+      if (rb->waiting[j])
+      {
+        RNG_UNLOCK (&rb->m);
+        return 0;
+      }
+    }
+
+    count += rb_count (rb);
+    size += rb->size;
+    RNG_UNLOCK (&rb->m);
+  }
+
+  return count * 100 / size;
+}
+
+/*
+ * Wait for space in the ring buffer.  Stop the ADC when it doesn't
+ * come in RNG_IDLE ticks.
+ */
+static void rng_wait_space (void)
+{
+  if (!rng_adc_stopped
+      && rt_event_recv(&rng_state, RNG_SPACE_AVAILABLE,
+           RT_EVENT_FLAG_AND|RT_EVENT_FLAG_CLEAR, rng_idle, NULL) == RT_EOK)
+  {
+    return;
+  }
+
+  if (!rng_adc_stopped)
+  {
+    adc_stop ();
+    rng_adc_stopped = 1;
+    rng_adc_tick = rt_tick_get ();
+    rng_duty.stops++;
+    return;
+  }
+
+  rt_event_recv(&rng_state, RNG_SPACE_AVAILABLE,
+      RT_EVENT_FLAG_AND|RT_EVENT_FLAG_CLEAR, RT_WAITING_FOREVER, NULL);
+}
+
+/*
+ * Start the ADC again, after consumers take words down to the refill
+ * level.  The noise source is started from scratch for MODE.
+ */
+static void rng_adc_resume (int mode)
+{
+  rt_tick_t off;
+
+  while (!rng_should_terminate && mode == neug_mode
+         && rng_level () > NEUG_ADC_REFILL)
+  {
+    rt_event_recv(&rng_state, RNG_SPACE_AVAILABLE,
+        RT_EVENT_FLAG_AND|RT_EVENT_FLAG_CLEAR, RT_WAITING_FOREVER, NULL);
+  }
+
+  off = rt_tick_get () - rng_adc_tick;
+  rng_duty.off_ticks += off;
+  if (off < NEUG_ADC_BREAK_EVEN)
+  {
+    rng_idle = rng_idle * 2 < NEUG_ADC_IDLE_MAX
+      ? rng_idle * 2 : NEUG_ADC_IDLE_MAX;
+  }
+  else
+  {
+    rng_idle = rng_idle / 2 > NEUG_ADC_IDLE_MIN
+      ? rng_idle / 2 : NEUG_ADC_IDLE_MIN;
+  }
+
+  rng_adc_stopped = 0;
+  rng_adc_measure = 1;
+  rng_adc_tick = rt_tick_get ();
+  adc_start ();
+  ep_init (mode);
+}
+
+/* Restart latency, to the first conversion after the start.  */
+static void rng_adc_started (void)
+{
+  rt_tick_t t = rt_tick_get () - rng_adc_tick;
+
+  rng_adc_measure = 0;
+  rng_duty.latency_last = t;
+  if (t > rng_duty.latency_max)
+  {
+    rng_duty.latency_max = t;
+  }
+}
+
+/**
+ * @brief  Get the counters of duty cycling of the ADC.
+ */
+void neug_duty_info (struct neug_duty_info *info)
+{
+  *info = rng_duty;
+  info->idle_ticks = rng_idle;
+  info->stopped = rng_adc_stopped;
+}
+#endif
+
+#ifdef PKG_USING_NEUG_RAW_TAP
+/*
+ * Raw tap: samples of a conversion (adc_buf, before the CRC32 filter)
+ * are copied into the monitoring ring given by neug_tap_start, for one
+ * conversion of TAP_EVERY.  It doesn't change the processing of the
+ * samples.  A conversion is copied as a whole, or dropped when there
+ * is no room for it; the generator never waits for the reader.
+ */
+static uint32_t *tap_buf;
+static int tap_size;
+static int tap_head;		/* Next sample to be written */
+static int tap_count;		/* Samples in the ring */
+static uint16_t tap_every, tap_turn;
+static uint32_t tap_copied, tap_dropped;
+#ifndef PKG_USING_NEUG_PULL
+static struct rt_mutex tap_m;
+static struct rt_semaphore tap_sem;
+static int tap_waiting;
+#else
+static void rng_step (void);
+#endif
+
+static void tap_put (const uint32_t *s, int n)
+{
+  RNG_LOCK (&tap_m);
+  if (tap_buf != RT_NULL && ++tap_turn >= tap_every)
+  {
+    tap_turn = 0;
+    if (tap_size - tap_count < n)
+    {
+      tap_dropped += n;
+    }
+    else
+    {
+      int first = tap_size - tap_head < n ? tap_size - tap_head : n;
+
+      memcpy (&tap_buf[tap_head], s, first * sizeof (uint32_t));
+      memcpy (tap_buf, s + first, (n - first) * sizeof (uint32_t));
+      tap_head = (tap_head + n) % tap_size;
+      tap_count += n;
+      tap_copied += n;
+
+#ifndef PKG_USING_NEUG_PULL
+      if (tap_waiting)
+      {
+        tap_waiting = 0;
+        rt_sem_release(&tap_sem);
+      }
+#endif
+    }
+  }
+  RNG_UNLOCK (&tap_m);
+}
+
+/**
+ * @brief  Start the raw tap into BUF of SIZE samples, copying one
+ *         conversion of EVERY (1 for all samples).  After neug_init.
+ * @return 0 on success, -1 on error.
+ */
+int neug_tap_start (uint32_t *buf, int size, int every)
+{
+  if (buf == RT_NULL || size < NEUG_ADC_BUF_SIZE || every < 1
+      || every > 0xffff)
+  {
+    return -1;
+  }
+
+  RNG_LOCK (&tap_m);
+  tap_buf = buf;
+  tap_size = size;
+  tap_head = tap_count = 0;
+  tap_every = every;
+  tap_turn = every - 1;		/* The next conversion is copied.  */
+  tap_copied = tap_dropped = 0;
+  RNG_UNLOCK (&tap_m);
+
+  return 0;
+}
+
+/**
+ * @brief  Stop the raw tap.  A reader waiting returns.
+ */
+void neug_tap_stop (void)
+{
+  RNG_LOCK (&tap_m);
+  tap_buf = RT_NULL;
+#ifndef PKG_USING_NEUG_PULL
+  if (tap_waiting)
+  {
+    tap_waiting = 0;
+    rt_sem_release(&tap_sem);
+  }
+#endif
+  RNG_UNLOCK (&tap_m);
+}
+
+/**
+ * @brief  Read up to N samples of the raw tap into P, waiting at most
+ *         TIMEOUT ticks when there are none.
+ * @return The number of samples, or -1 when the tap is stopped.
+ */
+int neug_tap_read (uint32_t *p, int n, int32_t timeout)
+{
+  int tail, first;
+
+  RNG_LOCK (&tap_m);
+  while (tap_buf != RT_NULL && tap_count == 0)
+  {
+#ifndef PKG_USING_NEUG_PULL
+    rt_err_t r;
+#endif
+
+    if (timeout == 0)
+    {
+      RNG_UNLOCK (&tap_m);
+      return 0;
+    }
+
+#ifdef PKG_USING_NEUG_PULL
+    /* Run the generator here, until a conversion is copied.  */
+    rng_step ();
+#else
+    tap_waiting = 1;
+    RNG_UNLOCK (&tap_m);
+    r = rt_sem_take(&tap_sem, timeout);
+    RNG_LOCK (&tap_m);
+
+    if (r != RT_EOK)
+    {
+      tap_waiting = 0;
+      RNG_UNLOCK (&tap_m);
+      return 0;
+    }
+#endif
+  }
+
+  if (tap_buf == RT_NULL)
+  {
+    RNG_UNLOCK (&tap_m);
+    return -1;
+  }
+
+  if (n > tap_count)
+  {
+    n = tap_count;
+  }
+
+  tail = (tap_head - tap_count + tap_size) % tap_size;
+  first = tap_size - tail < n ? tap_size - tail : n;
+  memcpy (p, &tap_buf[tail], first * sizeof (uint32_t));
+  memcpy (p + first, tap_buf, (n - first) * sizeof (uint32_t));
+  tap_count -= n;
+  RNG_UNLOCK (&tap_m);
+
+  return n;
+}
+
+/**
+ * @brief  Get the counters of the raw tap.
+ */
+void neug_tap_info (struct neug_tap_info *info)
+{
+  RNG_LOCK (&tap_m);
+  info->copied = tap_copied;
+  info->dropped = tap_dropped;
+  info->count = tap_count;
+  info->size = tap_size;
+  info->every = tap_every;
+  info->running = tap_buf != RT_NULL;
+  RNG_UNLOCK (&tap_m);
+}
+#endif
+
+#ifdef PKG_USING_NEUG_DEVICE
+/*
+ * Called after words are put into the ring buffer, and at the end of
+ * the warm-up, by the generator (without locks).  The device driver
+ * wakes up the pollers by this.
+ */
+static void (*rng_notify) (void);
+
+#define RNG_NOTIFY()  do { if (rng_notify) rng_notify (); } while (0)
+
+/**
+ * @brief  Set PROC to be called when words are available, or RT_NULL.
+ */
+void neug_set_notify (void (*proc) (void))
+{
+  rng_notify = proc;
+}
+#else
+#define RNG_NOTIFY()
+#endif
+
+static struct rng_rb *rng_rb;	/* Shard filled last */
+static int rng_mode;		/* Mode of the noise source */
+
+/*
+ * Start the noise source.
+ */
+static void rng_start (void)
+{
+  rng_rb = &the_ring_buffer[0];
+  rng_mode = neug_mode;
+
+  /* Init ADCs */
+  adc_init();
+
+  /* Enable ADCs */
+  adc_start ();
+
+  ep_init (rng_mode);
+
+#ifdef PKG_USING_NEUG_ADC_DUTY_CYCLE
+  rng_idle = NEUG_ADC_IDLE;
+  rng_adc_stopped = rng_adc_measure = 0;
+  memset (&rng_duty, 0, sizeof rng_duty);
+#endif
+}
+
+#ifdef PKG_USING_NEUG_DRBG_POOLS
+/*
+ * Accumulator of the DRBG, like Fortuna: one of NEUG_POOL_FEED outputs
+ * of conditioned data goes to NEUG_DRBG_POOLS pools in turn, instead
+ * of consumers.  It starts when the DRBG is first requested (or
+ * restored from the seed file), so the output is not taken from
+ * consumers when nobody uses the DRBG.  A pool is a SHA-256 context,
+ * hashed incrementally.  The R-th reseed uses the pool I when 2^I
+ * divides R, so that pool I is used once in 2^I reseeds, having more
+ * inputs, and the DRBG recovers from a compromise even if most inputs
+ * are known.
+ */
+#if !defined(PKG_USING_NEUG_DRBG)
+#error "PKG_USING_NEUG_DRBG_POOLS needs PKG_USING_NEUG_DRBG"
+#endif
+#ifndef NEUG_DRBG_POOLS
+#define NEUG_DRBG_POOLS 16
+#endif
+#if NEUG_DRBG_POOLS < 1 || NEUG_DRBG_POOLS > 32
+#error "NEUG_DRBG_POOLS should be 1 to 32"
+#endif
+#ifndef NEUG_POOL_FEED
+#define NEUG_POOL_FEED 8
+#endif
+#ifndef NEUG_POOL_MIN_BYTES
+#define NEUG_POOL_MIN_BYTES 32	/* of pool 0, for a reseed */
+#endif
+
+static tiny_sha2_context pool_ctx[NEUG_DRBG_POOLS];
+static uint32_t pool_bytes[NEUG_DRBG_POOLS];
+static uint8_t pool_next;	/* Pool for the next input */
+static uint8_t pool_turn;	/* Outputs since the last input */
+static uint32_t pool_reseeds;
+static volatile uint8_t pool_active;	/* The DRBG is seeded or requested */
+#ifndef PKG_USING_NEUG_PULL
+static struct rt_mutex pool_m;
+#endif
+
+static void pool_init (void)
+{
+  int i;
+
+  for (i = 0; i < NEUG_DRBG_POOLS; i++)
+  {
+    tiny_sha2_starts (&pool_ctx[i], 0);
+    pool_bytes[i] = 0;
+  }
+
+  pool_next = pool_turn = 0;
+  pool_reseeds = 0;
+  pool_active = 0;
+#ifndef PKG_USING_NEUG_PULL
+  rt_mutex_init(&pool_m, "rng_pool", RT_IPC_FLAG_FIFO);
+#endif
+}
+
+/*
+ * Add N words at VP to the next pool, when it's the turn and the pools
+ * are active.  Return 1 when they are taken.
+ */
+static int pool_feed (const uint32_t *vp, int n)
+{
+  if (!pool_active || ++pool_turn < NEUG_POOL_FEED)
+  {
+    return 0;
+  }
+
+  pool_turn = 0;
+  RNG_LOCK (&pool_m);
+  tiny_sha2_update (&pool_ctx[pool_next], (unsigned char *)vp, n * 4);
+  pool_bytes[pool_next] += n * 4;
+  RNG_UNLOCK (&pool_m);
+  pool_next = (pool_next + 1) % NEUG_DRBG_POOLS;
+
+  return 1;
+}
+#endif
+
+/*
+ * Put N words at VP into the ring buffer (or the requests of direct
+ * fill), after the warm-up.  DEST is the space of the ring buffer
+ * which VP may be written to already.
+ */
+static void rng_output (int mode, const uint32_t *vp, int n, uint32_t *dest)
+{
+  struct rng_rb *rb = rng_rb;
+  struct rng_rb *next;
+  int i;
+#if defined(PKG_USING_NEUG_DIRECT_FILL) && !defined(PKG_USING_NEUG_PULL)
+  int k;
+#endif
+
+  if (rng_warmup > 0)
+  {
+    if (rng_warmup > n)
+    {
+      rng_warmup -= n;
+      return;
+    }
+
+    vp += rng_warmup;
+    n -= rng_warmup;
+    rng_warmup = 0;
+
+    rng_ready = 1;
+    RNG_SEND (&rng_state, RNG_READY);
+    RNG_NOTIFY ();
+
+    if (n == 0)
+    {
+      return;
+    }
+  }
+
+#ifdef PKG_USING_NEUG_SEED_FILE
+  if (mode == NEUG_MODE_CONDITIONED && n >= NEUG_SEED_SIZE / 4
+      && rt_tick_get () - rng_seed_tick >= NEUG_SEED_SAVE_INTERVAL)
+  {
+    /* This output goes to the seed file, instead of consumers.  */
+#ifdef NEUG_SEED_WORK
+    if (!rng_seed_busy)
+    {
+      memcpy (rng_seed_buf, vp, NEUG_SEED_SIZE);
+      rng_seed_busy = 1;
+      rt_work_submit (&rng_seed_work, 0);
+    }
+#else
+    neug_seed_write ((const uint8_t *)vp);
+#endif
+    rng_seed_tick = rt_tick_get ();
+    return;
+  }
+#endif
+
+#ifdef PKG_USING_NEUG_DRBG_POOLS
+  if (mode == NEUG_MODE_CONDITIONED && pool_feed (vp, n))
+  {
+    return;
+  }
+#endif
+
+#if !defined(PKG_USING_NEUG_SEED_FILE) && !defined(PKG_USING_NEUG_DRBG_POOLS)
+  (void)mode;
+#endif
+
+#ifdef PKG_USING_NEUG_DIRECT_FILL
+  i = rng_req_put (vp, n);
+  if (i == n)
+  {
+    return;
+  }
+
+  vp += i;
+  n -= i;
+#endif
+
+  if (vp == dest)
+  {
+    NEUG_TRACE_BEGIN (NEUG_TRACE_PUBLISH);
+    RNG_LOCK (&rb->m);
+    rb_advance (rb, n);
+    rb_wakeup (rb);
+    RNG_UNLOCK (&rb->m);
+    neug_out_cnt += n;
+
+    /* notify data available */
+    RNG_SEND (&rb->available_state, RNG_DATA_AVAILABLE);
+    RNG_NOTIFY ();
+    NEUG_TRACE_END (NEUG_TRACE_PUBLISH);
+    return;
+  }
+
+  /*
+   * An output may be larger than the ring buffer (SHA-512), wait
+   * for space in the middle of the output, instead of dropping
+   * the rest.
+   */
+  NEUG_TRACE_BEGIN (NEUG_TRACE_PUBLISH);
+  if ((next = rng_shard_pick (rb)) != RT_NULL)
+  {
+    rb = rng_rb = next;
+  }
+
+  RNG_LOCK (&rb->m);
+  for (i = 0; i < n; i++)
+  {
+    while (rb->full)
+    {
+      rb_wakeup (rb);
+      RNG_UNLOCK (&rb->m);
+
+      /* notify data available */
+      RNG_SEND (&rb->available_state, RNG_DATA_AVAILABLE);
+      RNG_NOTIFY ();
+
+#ifdef PKG_USING_NEUG_PULL
+      /* Nobody takes words meanwhile, drop the rest.  */
+      if ((next = rng_shard_pick (rb)) == RT_NULL)
+      {
+        neug_out_cnt += i;
+        NEUG_TRACE_END (NEUG_TRACE_PUBLISH);
+        return;
+      }
+#else
+      while (1)
+      {
+#ifdef PKG_USING_NEUG_DIRECT_FILL
+        /*
+         * The rest goes to a request registered meanwhile, before the
+         * ring buffer emptied by the consumer of the request.
+         */
+        if ((k = rng_req_put (vp, n - i)) > 0)
+        {
+          vp += k;
+          n -= k;
+          if (i == n)
+          {
+            neug_out_cnt += i;
+            NEUG_TRACE_END (NEUG_TRACE_PUBLISH);
+            return;
+          }
+        }
+#endif
+        if ((next = rng_shard_pick (rb)) != RT_NULL)
+        {
+          break;
+        }
+
+#ifdef PKG_USING_NEUG_COND_WORKERS
+        /* The mode is being changed, the rest is not needed.  */
+        if (cond_flushing)
+        {
+          neug_out_cnt += i;
+          NEUG_TRACE_END (NEUG_TRACE_PUBLISH);
+          return;
+        }
+#endif
+        /* wait until space available event */
+        NEUG_TRACE_BEGIN (NEUG_TRACE_RING_FULL);
+#ifdef PKG_USING_NEUG_ADC_DUTY_CYCLE
+        rng_wait_space ();
+#else
+        rt_event_recv(&rng_state, RNG_SPACE_AVAILABLE, 
+            RT_EVENT_FLAG_AND|RT_EVENT_FLAG_CLEAR, RT_WAITING_FOREVER, NULL);
+#endif
+        NEUG_TRACE_END (NEUG_TRACE_RING_FULL);
+      }
+#endif
+
+      rb = rng_rb = next;
+      RNG_LOCK (&rb->m);
+    }
+
+    rb_add (rb, *vp++);
+  }
+
+  rb_wakeup (rb);
+  RNG_UNLOCK (&rb->m);
+  neug_out_cnt += n;
+
+  /* notify data available */
+  RNG_SEND (&rb->available_state, RNG_DATA_AVAILABLE);
+  RNG_NOTIFY ();
+  NEUG_TRACE_END (NEUG_TRACE_PUBLISH);
+}
+
+#ifdef PKG_USING_NEUG_COND_WORKERS
+/*
+ * Conditioning workers: the rng thread only filters and tests the
+ * samples, and the messages of hash_df are queued as jobs.  A worker
+ * takes the next job and computes the blocks before the feedback,
+ * which don't depend on other outputs, in parallel with others.  Then,
+ * in the order of the jobs, it adds the feedback from the previous
+ * output, finishes the hash and puts the output into the ring buffer.
+ * Thus, the output is same as the one by the rng thread alone.
+ *
+ * Each job has a semaphore for its turn, which is released by the
+ * worker of the previous job.  COND_FREE counts the free jobs, and
+ * COND_QUEUED counts the jobs queued (and the requests to exit).
+ */
+static struct cond_job {
+  struct rt_semaphore turn;
+  uint8_t discard;		/* Health test error in the samples */
+  uint8_t err;			/* Output monitor error, not counted yet */
+  union neug_cond_ctx ctx;
+  uint32_t msg[EP_MSG_SIZE / sizeof (uint32_t)];
+  uint32_t out[NEUG_COND_DIGEST_MAX / sizeof (uint32_t)];
+} cond_jobs[NEUG_COND_QUEUE];
+
+static struct rt_semaphore cond_free;
+static struct rt_semaphore cond_queued;
+static struct rt_mutex cond_m;
+static uint32_t cond_head;	/* Jobs queued so far */
+static uint32_t cond_tail;	/* Jobs taken by workers so far */
+
+static void cond_finish (struct cond_job *job)
+{
+  uint8_t *msg = (uint8_t *)job->msg;
+  int fb_pos = cond->noise_inputs + 5;
+  int fb = cond->digest_size / 2;
+  int words = cond->digest_size / sizeof (uint32_t);
+  int hashed = (fb_pos / cond->block_size) * cond->block_size;
+  uint32_t err = job->discard;
+
+  memcpy (msg + fb_pos, cond_feedback, fb);
+  cond->update (&job->ctx, msg + hashed, fb_pos + fb - hashed);
+  cond->finish (&job->ctx, (uint8_t *)job->out);
+  memcpy (cond_feedback, job->out, fb);
+
+#ifdef PKG_USING_NEUG_OUTPUT_MONITOR
+  /* Counted by the rng thread, when it reuses the job.  */
+  job->err = output_monitor_test (job->out, words);
+  err |= job->err;
+#endif
+
+  if (err)
+  {
+    NEUG_TRACE_INSTANT (NEUG_TRACE_DISCARD);
+    neug_discard_cnt += words;
+  }
+  else if (!cond_flushing)
+  {
+    rng_output (NEUG_MODE_CONDITIONED, job->out, words, RT_NULL);
+  }
+
+  memset (job->out, 0, sizeof job->out);
+}
+
+static void cond_worker (void *parameter)
+{
+  (void)parameter;
+
+  while (1)
+  {
+    struct cond_job *job;
+    int i;
+
+    rt_sem_take(&cond_queued, RT_WAITING_FOREVER);
+    rt_mutex_take(&cond_m, RT_WAITING_FOREVER);
+    if (cond_tail == cond_head)
+    {
+      /* No job for this, it's the request to exit.  */
+      rt_mutex_release(&cond_m);
+      break;
+    }
+
+    i = cond_tail++ % NEUG_COND_QUEUE;
+    rt_mutex_release(&cond_m);
+
+    job = &cond_jobs[i];
+    cond->starts (&job->ctx);
+    cond->update (&job->ctx, (uint8_t *)job->msg,
+                  (cond->noise_inputs + 5) / cond->block_size
+                  * cond->block_size);
+
+    rt_sem_take(&job->turn, RT_WAITING_FOREVER);
+    cond_finish (job);
+    rt_sem_release(&cond_jobs[(i + 1) % NEUG_COND_QUEUE].turn);
+    rt_sem_release(&cond_free);
+  }
+}
+
+/*
+ * Count the errors of the output monitor in JOB, which is done.  Only
+ * the rng thread counts, and it doesn't discard other outputs.
+ */
+static void cond_collect (struct cond_job *job)
+{
+  if (job->err)
+  {
+    noise_source_error_count (job->err);
+    job->err = 0;
+  }
+}
+
+/*
+ * Queue the outputs of N words in ep_msg.  It waits for a free job,
+ * when all workers are busy.
+ */
+static void cond_submit (int n, int discard)
+{
+  const uint8_t *msg = (const uint8_t *)ep_msg;
+  int words = cond->digest_size / sizeof (uint32_t);
+
+  for (; n > 0; n -= words, msg += EP_MSG_SIZE)
+  {
+    struct cond_job *job;
+
+    rt_sem_take(&cond_free, RT_WAITING_FOREVER);
+    job = &cond_jobs[cond_head % NEUG_COND_QUEUE];
+    cond_collect (job);
+    memcpy (job->msg, msg, cond->noise_inputs + 5);
+    job->discard = discard;
+
+    rt_mutex_take(&cond_m, RT_WAITING_FOREVER);
+    cond_head++;
+    rt_mutex_release(&cond_m);
+    rt_sem_release(&cond_queued);
+  }
+}
+
+/*
+ * Wait for all jobs done, dropping their outputs.  Called by the rng
+ * thread on the mode change.
+ */
+static void cond_flush (void)
+{
+  int i;
+
+  cond_flushing = 1;
+  /* Wake up the worker which waits for space.  */
+  RNG_SEND (&rng_state, RNG_SPACE_AVAILABLE);
+
+  for (i = 0; i < NEUG_COND_QUEUE; i++)
+  {
+    rt_sem_take(&cond_free, RT_WAITING_FOREVER);
+  }
+
+  for (i = 0; i < NEUG_COND_QUEUE; i++)
+  {
+    cond_collect (&cond_jobs[i]);
+    rt_sem_release(&cond_free);
+  }
+
+  cond_flushing = 0;
+}
+
+static int cond_start (void)
+{
+  char name[RT_NAME_MAX];
+  int i;
+
+  rt_sem_init(&cond_free, "rng_cfr", NEUG_COND_QUEUE, RT_IPC_FLAG_FIFO);
+  rt_sem_init(&cond_queued, "rng_cq", 0, RT_IPC_FLAG_FIFO);
+  rt_mutex_init(&cond_m, "rng_cm", RT_IPC_FLAG_FIFO);
+  for (i = 0; i < NEUG_COND_QUEUE; i++)
+  {
+    rt_sem_init(&cond_jobs[i].turn, "rng_ct", i == 0, RT_IPC_FLAG_FIFO);
+    cond_jobs[i].err = 0;
+  }
+
+  cond_head = cond_tail = 0;
+  cond_flushing = 0;
+
+  for (i = 0; i < NEUG_COND_WORKERS; i++)
+  {
+    rt_thread_t t;
+
+    rt_snprintf (name, sizeof name, "rng_c%d", i);
+    /* Same priority as the rng thread, boosted together.  */
+    rt_mutex_take(&rng_boost_m, RT_WAITING_FOREVER);
+    t = rt_thread_create(name, cond_worker, RT_NULL, 2048, rng_prio, 32);
+    cond_threads[i] = t;
+    rt_mutex_release(&rng_boost_m);
+
+    if (t == RT_NULL)
+    {
+      return -1;
+    }
+
+    rt_thread_startup(t);
+  }
+
+  return 0;
+}
+
+/* Let the workers exit, after the jobs queued.  */
+static void cond_stop (void)
+{
+  int i;
+
+  for (i = 0; i < NEUG_COND_WORKERS; i++)
+  {
+    rt_mutex_take(&rng_boost_m, RT_WAITING_FOREVER);
+    if (cond_threads[i] != RT_NULL)
+    {
+      cond_threads[i] = RT_NULL;
+      rt_sem_release(&cond_queued);
+    }
+    rt_mutex_release(&rng_boost_m);
+  }
+}
+#endif
+
+/*
+ * A round of the generator: wait for the ADC conversion, and process
+ * the samples.  When there is an output, it's added to the ring
+ * buffer.  Called by the rng thread, or by consumers in pull mode.
+ */
+static void rng_step (void)
+{
+  struct rng_rb *rb = rng_rb;
+  int mode = rng_mode;
+  int err;
+  int n, room;
+  uint32_t *dest, *space;	/* Destination of output, in the ring */
+  struct rng_rb *next;
+
+  NEUG_TRACE_POLL ();
+
+#ifdef PKG_USING_NEUG_ADC_DUTY_CYCLE
+  if (rng_adc_stopped)
+  {
+    rng_adc_resume (mode);
+    return;
+  }
+#endif
+
+  /* return 0 on success. */
+  NEUG_TRACE_BEGIN (NEUG_TRACE_ADC);
+  err = adc_wait_completion ();
+  NEUG_TRACE_END (NEUG_TRACE_ADC);
+
+#ifdef PKG_USING_NEUG_ADC_DUTY_CYCLE
+  if (rng_adc_measure)
+  {
+    rng_adc_started ();
+  }
+#endif
+
+  RNG_LOCK (&mode_mtx);
+  /* if err occur or mode change */
+  if (err || mode != neug_mode)
+  {
+    mode = rng_mode = neug_mode;
+    NEUG_TRACE_INSTANT (NEUG_TRACE_MODE);
+
+#ifdef PKG_USING_NEUG_COND_WORKERS
+    cond_flush ();
+#endif
+    noise_source_cnt_max_reset ();
+#ifdef PKG_USING_NEUG_OUTPUT_MONITOR
+    output_monitor_reset ();
+#endif
+
+    /* Discarding data available, re-initiate from the start.  */
+    ep_init (mode);
+
+    rng_credit = rng_word_credit (mode);
+
+    RNG_UNLOCK (&mode_mtx);
+
+    /* notify mode condition event */
+    RNG_SEND (&mode_cond, MODE_CONDITION);
+
+    return;
+  }
+  else
+  {
+    RNG_UNLOCK (&mode_mtx);
+  }
+
+#ifdef PKG_USING_NEUG_RAW_TAP
+  if (tap_buf != RT_NULL)
+  {
+    tap_put (adc_buf, ep_conversion_size ());
+  }
+#endif
+
+  dest = space = RT_NULL;
+  room = 0;
+  if (rng_warmup == 0 && ep_will_output ())
+  {
+    /*
+     * Let the output be written into the buffer of the request, or
+     * into the ring buffer directly.
+     */
+#ifdef PKG_USING_NEUG_DIRECT_FILL
+    dest = rng_req_space (&room);
+#endif
+    if (dest == RT_NULL)
+    {
+      if ((next = rng_shard_pick (rb)) != RT_NULL)
+      {
+        rb = rng_rb = next;
+      }
+
+      RNG_LOCK (&rb->m);
+      dest = space = rb_space (rb, &room);
+      RNG_UNLOCK (&rb->m);
+    }
+  }
+
+  if ((n = ep_process (mode, dest, room)) > 0)
+  {
+#ifdef PKG_USING_NEUG_COND_WORKERS
+    if (mode == NEUG_MODE_CONDITIONED)
+    {
+      int discard = neug_err_state != 0;
+
+      if (discard)
+      {
+        noise_source_error_reset ();
+      }
+
+      cond_submit (n, discard);
+      return;
+    }
+#endif
+
+#ifdef PKG_USING_NEUG_OUTPUT_MONITOR
+    if (mode == NEUG_MODE_CONDITIONED)
+    {
+      uint32_t om_err = output_monitor_test (ep_output (mode), n);
+
+      if (om_err)
+      {
+        noise_source_error (om_err);
+      }
+    }
+#endif
+
+    /* noise err */
+    if (neug_err_state != 0 && 
+      (mode == NEUG_MODE_CONDITIONED || mode == NEUG_MODE_RAW))
+    {
+      /* Don't use the result and do it again.  */
+      NEUG_TRACE_INSTANT (NEUG_TRACE_DISCARD);
+      neug_discard_cnt += n;
+      noise_source_error_reset ();
+      return;
+    }
+
+    rng_output (mode, ep_output (mode), n, space);
+  }
+}
+
+#ifndef PKG_USING_NEUG_PULL
+/**
+ * @brief Random number generation thread.
+ */
+static void rng (void* parameter)
+{
+  (void)parameter;
+
+  rng_start ();
+
+  while (!rng_should_terminate)
+  {
+    rng_step ();
+  }
+
+#ifdef PKG_USING_NEUG_COND_WORKERS
+  cond_stop ();
+#endif
+#ifdef PKG_USING_NEUG_ADC_DUTY_CYCLE
+  if (rng_adc_stopped)
+  {
+    return;
+  }
+#endif
+  adc_stop();
+}
+#endif
+
+#ifdef PKG_USING_NEUG_DRBG
+/*
+ * Hash_DRBG for NEUG_CLASS_DRBG_PR and NEUG_CLASS_DRBG, seeded from
+ * the ring buffer.  It's instantiated at the first request.
+ */
+#ifndef NEUG_DRBG_RESEED_INTERVAL
+#define NEUG_DRBG_RESEED_INTERVAL 1024	/* requests */
+#endif
+
+#define DRBG_SEED_BITS   384	/* entropy input and nonce */
+#define DRBG_RESEED_BITS 256
+#define DRBG_SEED_WORDS   64	/* at most */
+
+static drbg_context neug_drbg;
+#ifndef PKG_USING_NEUG_PULL
+static struct rt_mutex drbg_m;
+#endif
+static int drbg_seeded;
+static int drbg_stale;		/* Seeded only by the seed file */
+static uint32_t drbg_requests;	/* Since the last (re)seed */
+static uint32_t drbg_seed_buf[DRBG_SEED_WORDS];	/* By neug_drbg_try_seed */
+static int drbg_seed_len;
+#endif
+
+/**
+ * @brief  Select the conditioner by its name, before neug_init.
+ * @return 0 on success, -1 when not available.
+ */
+int neug_conditioner_select (const char *name)
+{
+  const struct neug_conditioner *c = neug_conditioner_find (name);
+
+  if (c == RT_NULL || rng_started)
+  {
+    return -1;
+  }
+
+  cond = c;
+  return 0;
+}
+
+#ifdef PKG_USING_NEUG_SEED_FILE
+#ifdef NEUG_SEED_WORK
+/* Write the output saved by the rng thread, in the system work queue.  */
+static void neug_seed_work (struct rt_work *work, void *data)
+{
+  (void)work;
+  (void)data;
+
+  neug_seed_write (rng_seed_buf);
+  memset (rng_seed_buf, 0, sizeof rng_seed_buf);
+  rng_seed_busy = 0;
+}
+#endif
+
+static void neug_seed_init (void)
+{
+#ifdef NEUG_SEED_WORK
+  rt_work_init (&rng_seed_work, neug_seed_work, RT_NULL);
+  rng_seed_busy = 0;
+#endif
+  rng_seed_tick = rt_tick_get ();
+}
+
+/*
+ * Instantiate the DRBG by the seed file, so that NEUG_CLASS_DRBG can be
+ * served before the warm-up.  It's reseeded as soon as entropy is
+ * available.  The seed file is replaced at once, so that the same seed
+ * is never used again, even if it stops before next save; when it
+ * can't be replaced, the seed is not used.
+ *
+ * It's done at the first request of the DRBG, not by neug_init, which
+ * runs from random_init before DFS is mounted.  Called with drbg_m
+ * held, while the DRBG is not seeded.
+ */
+static void neug_seed_restore (void)
+{
+  uint8_t seed[NEUG_SEED_SIZE];
+
+  if (neug_seed_read (seed) < 0)
+  {
+    /* Save one soon.  */
+    rng_seed_tick = rt_tick_get () - NEUG_SEED_SAVE_INTERVAL;
+    return;
+  }
+
+  drbg_instantiate (&neug_drbg, seed, sizeof seed, unique_device_id (), 12);
+  drbg_generate (&neug_drbg, seed, sizeof seed);
+  if (neug_seed_write (seed) < 0)
+  {
+    memset (&neug_drbg, 0, sizeof neug_drbg);
+  }
+  else
+  {
+    drbg_seeded = drbg_stale = 1;
+  }
+
+  memset (seed, 0, sizeof seed);
+}
+#endif
+
+/**
+ * @brief  Initialize NeuG.
+ * @return 0 on success, -1 when the conditioner fails its self test.
+ */
+int neug_init (uint32_t *buf, uint8_t size)
+{
+  const uint32_t *u = (const uint32_t *)unique_device_id ();
+  int i, shard_size;
+
+  /* Its mutexes, events and the rng thread are in use already.  */
+  if (rng_started)
+  {
+    return -1;
+  }
+
+  if (cond == RT_NULL)
+  {
+    cond = neug_cond_default;
+  }
+
+  if (neug_conditioner_selftest (cond) < 0)
+  {
+    rt_kprintf ("NeuG: self test of %s failed\n", cond->name);
+    return -1;
+  }
+
+  crc32_rv_reset ();
+
+  /*
+   * This initialization ensures that it generates different sequence
+   * even if all physical conditions are same.
+   */
+  for (i = 0; i < 3; i++)
+  {
+    crc32_rv_step (*u++);
+  }
+
+  neug_mode = NEUG_MODE_CONDITIONED;
+
+  rng_warmup = NEUG_PRE_LOOP;
+  rng_ready = 0;
+
+  /*
+   * Split BUF into shards of NEUG_SHARD_MIN words at least, the last
+   * one takes the remainder.
+   */
+  rng_shards = size / NEUG_SHARD_MIN;
+  if (rng_shards > NEUG_SHARDS)
+  {
+    rng_shards = NEUG_SHARDS;
+  }
+  else if (rng_shards == 0)
+  {
+    rng_shards = 1;
+  }
+
+  shard_size = size / rng_shards;
+  for (i = 0; i < rng_shards; i++)
+  {
+    rb_init (&the_ring_buffer[i], buf + i * shard_size,
+             i == rng_shards - 1 ? size - i * shard_size : shard_size);
+  }
+
+  rng_credit = rng_word_credit (NEUG_MODE_CONDITIONED);
+#ifdef PKG_USING_NEUG_DRBG
+#ifndef PKG_USING_NEUG_PULL
+  rt_mutex_init(&drbg_m, "rng_drbg", RT_IPC_FLAG_FIFO);
+#endif
+  drbg_seeded = drbg_stale = 0;
+  drbg_seed_len = 0;
+#endif
+#ifdef PKG_USING_NEUG_DRBG_POOLS
+  pool_init ();
+#endif
+#ifdef PKG_USING_NEUG_RAW_TAP
+  tap_buf = RT_NULL;
+#ifndef PKG_USING_NEUG_PULL
+  rt_mutex_init(&tap_m, "rng_tap", RT_IPC_FLAG_FIFO);
+  rt_sem_init(&tap_sem, "rng_tap", 0, RT_IPC_FLAG_FIFO);
+  tap_waiting = 0;
+#endif
+#endif
+#ifdef PKG_USING_NEUG_SEED_FILE
+  neug_seed_init ();
+#endif
+#ifdef PKG_USING_NEUG_DIRECT_FILL
+  rng_req_head = rng_req_tail = RT_NULL;
+#ifndef PKG_USING_NEUG_PULL
+  rt_mutex_init(&rng_req_m, "rng_req", RT_IPC_FLAG_FIFO);
+#endif
+#endif
+  rng_started = 1;
+
+#ifdef PKG_USING_NEUG_PULL
+  /* The warm-up is done by the first consumer.  */
+  rng_start ();
+#else
+  /* Before the rng thread, as consumers may use them at once.  */
+  rt_mutex_init(&mode_mtx, "rng_mode", RT_IPC_FLAG_FIFO);
+  rt_event_init(&mode_cond, "rng_mode", RT_IPC_FLAG_FIFO);
+  rng_should_terminate = 0;
+  rt_event_init(&rng_state, "rng_st", RT_IPC_FLAG_FIFO);
+  rt_mutex_init(&rng_boost_m, "rng_bst", RT_IPC_FLAG_FIFO);
+  memset (rng_boost_cnt, 0, sizeof rng_boost_cnt);
+  rng_prio = NEUG_RNG_PRIORITY;
+#ifdef PKG_USING_NEUG_COND_WORKERS
+  /* Without workers, nothing would be conditioned.  */
+  if (cond_start () < 0)
+  {
+    rt_kprintf ("NeuG: no conditioning workers\n");
+    cond_stop ();
+    return -1;
+  }
+#endif
+  rng_thread = rt_thread_create("rng", rng, RT_NULL,
+                    2048 + NEUG_SEED_STACK, NEUG_RNG_PRIORITY, 32);
+
+  if (rng_thread == RT_NULL)
+  {
+#ifdef PKG_USING_NEUG_COND_WORKERS
+    cond_stop ();
+#endif
+    return -1;
+  }
+
+  rt_thread_startup(rng_thread);
+#endif
+  return 0;
+}
+
+/**
+ * @brief  Return 1 when NeuG is started by neug_init, 0 otherwise.
+ */
+int neug_is_started (void)
+{
+  return rng_started;
+}
+
+/**
+ * @brief  Return 1 when the warm-up is done, 0 otherwise.
+ */
+int neug_is_ready (void)
+{
+  return rng_ready;
+}
+
+/**
+ * @brief  Wait for the warm-up, at most TIMEOUT ticks.
+ * @return 0 when ready, -1 on timeout.
+ */
+int neug_wait_ready (int32_t timeout)
+{
+#ifdef PKG_USING_NEUG_PULL
+  (void)timeout;
+
+  while (!rng_ready)
+  {
+    rng_step ();
+  }
+
+  return 0;
+#else
+  rt_uint8_t boost;
+  rt_err_t r;
+
+  if (rng_ready)
+  {
+    return 0;
+  }
+
+  /* RNG_READY is never cleared once it's sent.  */
+  boost = rng_boost_enter ();
+  r = rt_event_recv(&rng_state, RNG_READY, RT_EVENT_FLAG_AND, timeout, NULL);
+  rng_boost_leave (boost);
+
+  return r == RT_EOK ? 0 : -1;
+#endif
+}
+
+/**
+ * @brief  Get random word (32-bit) from NeuG, for a consumer of class
+ *         PRIO (NEUG_PRIO_BULK, NEUG_PRIO_NORMAL or NEUG_PRIO_URGENT).
+ * @detail Waiting consumers of higher class are served first, and the
+ *         last NEUG_PRIO_RESERVE words are only for NEUG_PRIO_URGENT.
+ *         With NEUG_KICK_FILLING, it wakes up RNG thread.
+ *         With NEUG_NO_KICK, it doesn't wake up RNG thread automatically,
+ *         it is needed to call neug_kick_filling later.
+ */
+uint32_t neug_get_prio (int kick, int prio)
+{
+  struct rng_rb *rb = rb_local ();
+#ifndef PKG_USING_NEUG_PULL
+  rt_uint8_t boost;
+#endif
+  uint32_t v;
+
+  RNG_LOCK (&rb->m);
+  while (!rb_may_take (rb, prio))
+  {
+    if (rng_shards > 1)
+    {
+      RNG_UNLOCK (&rb->m);
+      if (rb_steal (rb, prio, &v) == 0)
+      {
+        goto done;
+      }
+
+      RNG_LOCK (&rb->m);
+      if (rb_may_take (rb, prio))
+      {
+        break;
+      }
+    }
+
+#ifdef PKG_USING_NEUG_PULL
+    /* Run the generator here, until data available.  */
+    NEUG_TRACE_BEGIN (NEUG_TRACE_CONSUMER);
+    rng_step ();
+    NEUG_TRACE_END (NEUG_TRACE_CONSUMER);
+#else
+    rb->waiting[prio]++;
+    RNG_UNLOCK (&rb->m);
+
+    /* wait until data available for this class */
+    NEUG_TRACE_BEGIN (NEUG_TRACE_CONSUMER);
+    boost = rng_boost_enter ();
+    rt_event_recv(&rb->available_state, RNG_DATA_PRIO (prio),
+        RT_EVENT_FLAG_AND|RT_EVENT_FLAG_CLEAR, RT_WAITING_FOREVER, NULL);
+    rng_boost_leave (boost);
+    NEUG_TRACE_END (NEUG_TRACE_CONSUMER);
+
+    RNG_LOCK (&rb->m);
+    rb->waiting[prio]--;
+#endif
+  }
+
+  v = rb_del (rb);
+  rb_wakeup (rb);
+
+  RNG_UNLOCK (&rb->m);
+
+ done:
+  if (kick)
+  {
+    /* notify space available event */
+    RNG_SEND (&rng_state, RNG_SPACE_AVAILABLE);
+  }
+
+  return v;
+}
+
+/**
+ * @brief  Get random word (32-bit) from NeuG.
+ * @detail With NEUG_KICK_FILLING, it wakes up RNG thread.
+ *         With NEUG_NO_KICK, it doesn't wake up RNG thread automatically,
+ *         it is needed to call neug_kick_filling later.
+ */
+uint32_t neug_get (int kick)
+{
+  return neug_get_prio (kick, NEUG_PRIO_NORMAL);
+}
+
+int neug_get_nonblock_prio (uint32_t *p, int prio)
+{
+  struct rng_rb *rb = rb_local ();
+  int r = 0;
+
+  RNG_LOCK (&rb->m);
+  if (!rb_may_take (rb, prio))
+  {
+    RNG_UNLOCK (&rb->m);
+    if (rng_shards == 1 || rb_steal (rb, prio, p) < 0)
+    {
+      r = -1;
+    }
+
+    /* notify space available event */
+    RNG_SEND (&rng_state, RNG_SPACE_AVAILABLE);
+    return r;
+  }
+  else
+  {
+    *p = rb_del (rb);
+    rb_wakeup (rb);
+  }
+
+  RNG_UNLOCK (&rb->m);
+
+  return r;
+}
+
+int neug_get_nonblock (uint32_t *p)
+{
+  return neug_get_nonblock_prio (p, NEUG_PRIO_NORMAL);
+}
+
+/**
+ * @brief  Peek the words ready in the ring buffer, without copy.
+ * @detail SPAN is set to up to two regions of the words, in the shard
+ *         of the caller (or another one, when it's empty).  The words
+ *         must be released by neug_commit.  Until then, other
+ *         consumers take the words after them, and nobody else can
+ *         peek the shard.  A thread can have only one peek at a
+ *         time.  It never waits, and wakes up RNG thread when there
+ *         are no words.
+ * @return The number of words peeked.
+ */
+int neug_peek (struct neug_span *span)
+{
+  struct rng_rb *local = rb_local ();
+  int i, j = local - the_ring_buffer;
+
+  span->n[0] = span->n[1] = 0;
+
+  for (i = 0; i < rng_shards; i++)
+  {
+    struct rng_rb *rb = &the_ring_buffer[(j + i) % rng_shards];
+
+    RNG_LOCK (&rb->m);
+    if (rb->peeker == RT_NULL && rb_may_take (rb, NEUG_PRIO_NORMAL))
+    {
+      int n = rb_avail (rb) - rb->reserve;
+      int first = rb->size - rb->head;
+
+      span->p[0] = &rb->buf[rb->head];
+      span->n[0] = n < first ? n : first;
+      span->p[1] = &rb->buf[0];
+      span->n[1] = n - span->n[0];
+      rb->peeker = rt_thread_self ();
+      rb->peeked = n;
+      RNG_UNLOCK (&rb->m);
+      return n;
+    }
+
+    RNG_UNLOCK (&rb->m);
+  }
+
+  /* notify space available event */
+  RNG_SEND (&rng_state, RNG_SPACE_AVAILABLE);
+  return 0;
+}
+
+/**
+ * @brief  Release the peek by neug_peek, consuming the first N words.
+ * @detail The words after N are left for other consumers, so they must
+ *         not be used.  They are moved behind the words taken by others
+ *         meanwhile.
+ * @return 0 on success, -1 when the caller has no peek.
+ */
+int neug_commit (int n)
+{
+  rt_thread_t self = rt_thread_self ();
+  int i, j;
+
+  for (i = 0; i < rng_shards; i++)
+  {
+    struct rng_rb *rb = &the_ring_buffer[i];
+
+    if (rb->peeker == self)
+    {
+      RNG_LOCK (&rb->m);
+      n = n < 0 ? 0 : n > rb->peeked ? rb->peeked : n;
+      if (rb->skipped)
       {
-        rb_add (rb, *vp++);
-        if (rb->full)
+        for (j = rb->peeked - 1; j >= n; j--)
         {
-          break;
+          rb->buf[(rb->head + rb->skipped + j) % rb->size]
+            = rb->buf[(rb->head + j) % rb->size];
         }
       }
 
-      rt_mutex_release(&rb->m);
+      if (n + rb->skipped > 0)
+      {
+        rb->head = (rb->head + n + rb->skipped) % rb->size;
+        rb->full = 0;
+        rb->empty = (rb->head == rb->tail);
+      }
+
+      rb->taken += n;
+      rb->peeker = RT_NULL;
+      rb->peeked = rb->skipped = 0;
+      rb_wakeup (rb);
+      RNG_UNLOCK (&rb->m);
 
-      /* notify data available */
-      rt_event_send(&rb->available_state, RNG_DATA_AVAILABLE);
+      /* notify space available event */
+      RNG_SEND (&rng_state, RNG_SPACE_AVAILABLE);
+      return 0;
     }
   }
 
-  adc_stop();
+  return -1;
 }
 
-static struct rng_rb the_ring_buffer;
+/**
+ * @brief  Get N random words into P.
+ * @detail Words ready in the ring buffer are copied at once by
+ *         neug_peek/neug_commit, it only waits word by word when it's
+ *         empty.  With PKG_USING_NEUG_DIRECT_FILL, when NEUG_DIRECT_MIN
+ *         words or more are left, the generator writes them into P.
+ */
+void neug_get_words (uint32_t *p, int n)
+{
+  struct neug_span span;
+  int i, k;
+
+  while (n > 0)
+  {
+    if (neug_peek (&span) == 0)
+    {
+#ifdef PKG_USING_NEUG_DIRECT_FILL
+      if (n >= NEUG_DIRECT_MIN)
+      {
+        rng_req_wait (p, n);
+        return;
+      }
+#endif
+      *p++ = neug_get (NEUG_KICK_FILLING);
+      n--;
+      continue;
+    }
+
+    for (i = k = 0; i < 2 && n > 0; i++)
+    {
+      int m = span.n[i] < n ? span.n[i] : n;
+
+      memcpy (p, span.p[i], m * sizeof (uint32_t));
+      p += m;
+      n -= m;
+      k += m;
+    }
+
+    neug_commit (k);
+  }
+}
 
 /**
- * @brief Initialize NeuG.
+ * @brief  Return bits of entropy credited to the words in the ring
+ *         buffer, based on NEUG_MIN_ENTROPY.
  */
-void neug_init (uint32_t *buf, uint8_t size)
+uint32_t neug_entropy_avail (void)
 {
-  const uint32_t *u = (const uint32_t *)unique_device_id ();
-  struct rng_rb *rb = &the_ring_buffer;
+  uint32_t words = 0;
   int i;
 
-  crc32_rv_reset ();
+  for (i = 0; i < rng_shards; i++)
+  {
+    struct rng_rb *rb = &the_ring_buffer[i];
 
-  /*
-   * This initialization ensures that it generates different sequence
-   * even if all physical conditions are same.
-   */
-  for (i = 0; i < 3; i++)
+    RNG_LOCK (&rb->m);
+    words += rb_avail (rb);
+    RNG_UNLOCK (&rb->m);
+  }
+
+  return words * rng_credit / 100;
+}
+
+/**
+ * @brief  Return the number of words a consumer of NEUG_PRIO_NORMAL can
+ *         take now, without waiting.
+ */
+int neug_words_avail (void)
+{
+  int words = 0;
+  int i;
+
+  for (i = 0; i < rng_shards; i++)
   {
-    crc32_rv_step (*u++);
+    struct rng_rb *rb = &the_ring_buffer[i];
+
+    RNG_LOCK (&rb->m);
+    if (rb_may_take (rb, NEUG_PRIO_NORMAL))
+    {
+      words += rb_avail (rb) - rb->reserve;
+    }
+
+    RNG_UNLOCK (&rb->m);
   }
 
-  neug_mode = NEUG_MODE_CONDITIONED;
+  return words;
+}
+
+/**
+ * @brief  Get the occupancy and counters of the shard I.
+ * @return 0 on success, -1 when there is no such shard.
+ */
+int neug_shard_info (int i, struct neug_shard_info *info)
+{
+  struct rng_rb *rb;
+
+  if (i < 0 || i >= rng_shards)
+  {
+    return -1;
+  }
+
+  rb = &the_ring_buffer[i];
+  RNG_LOCK (&rb->m);
+  info->count = rb_count (rb);
+  info->size = rb->size;
+  info->added = rb->added;
+  info->taken = rb->taken;
+  info->stolen = rb->stolen;
+  RNG_UNLOCK (&rb->m);
+
+  return 0;
+}
+
+#ifdef PKG_USING_NEUG_DRBG
+/*
+ * Take words from the ring buffer into BUF, until BITS of entropy are
+ * credited.  With BLOCK == 0, it takes nothing unless enough words
+ * are there in the local shard for NEUG_PRIO_BULK.  Return the number
+ * of words, or -1 when it's not possible.
+ */
+static int neug_take_entropy (uint32_t *buf, int bits, int block)
+{
+  struct rng_rb *rb = rb_local ();
+  uint16_t credit = rng_credit;
+  int words, i;
+
+  if (credit == 0)
+  {
+    return -1;
+  }
+
+  words = (bits * 100 + credit - 1) / credit;
+  if (words > DRBG_SEED_WORDS)
+  {
+    return -1;
+  }
+
+  if (block)
+  {
+    for (i = 0; i < words; i++)
+    {
+      buf[i] = neug_get (NEUG_KICK_FILLING);
+    }
+
+    return words;
+  }
+
+  RNG_LOCK (&rb->m);
+  if (!rb_may_take (rb, NEUG_PRIO_BULK)
+      || rb_avail (rb) < words + rb->reserve)
+  {
+    RNG_UNLOCK (&rb->m);
+    return -1;
+  }
+
+  for (i = 0; i < words; i++)
+  {
+    buf[i] = rb_del (rb);
+  }
+
+  rb_wakeup (rb);
+  RNG_UNLOCK (&rb->m);
+
+  /* notify space available event */
+  RNG_SEND (&rng_state, RNG_SPACE_AVAILABLE);
+
+  return words;
+}
+
+/*
+ * Instantiate the DRBG by SEED of WORDS, or reseed it when it's
+ * seeded.  Called with drbg_m held.
+ */
+static void neug_drbg_input (const uint32_t *seed, int words)
+{
+  if (!drbg_seeded)
+  {
+    /* Personalization string is the device ID.  */
+    drbg_instantiate (&neug_drbg, (const uint8_t *)seed, words * 4,
+                      unique_device_id (), 12);
+    drbg_seeded = 1;
+  }
+  else
+  {
+    drbg_reseed (&neug_drbg, (const uint8_t *)seed, words * 4);
+  }
 
-  rb_init (rb, buf, size);
+  drbg_stale = 0;
+  drbg_requests = 0;
+}
+
+/*
+ * (Re)seed the DRBG.  Called with drbg_m held.
+ */
+static int neug_drbg_seed (int block)
+{
+  uint32_t seed[DRBG_SEED_WORDS];
+  int words;
 
-  rng_thread = rt_thread_create("rng", rng, rb, 
-                    2048, RT_THREAD_PRIORITY_MAX -2, 32);
+  if (!drbg_seeded)
+  {
+    words = neug_take_entropy (seed, DRBG_SEED_BITS, 1);
+  }
+  else
+  {
+    words = neug_take_entropy (seed, DRBG_RESEED_BITS, block);
+  }
 
-  if (rng_thread != RT_NULL)
+  if (words < 0)
   {
-    rt_thread_startup(rng_thread);
+    return -1;
   }
+
+  neug_drbg_input (seed, words);
+  memset (seed, 0, words * 4);
+  return 0;
 }
 
 /**
- * @brief  Get random word (32-bit) from NeuG.
- * @detail With NEUG_KICK_FILLING, it wakes up RNG thread.
- *         With NEUG_NO_KICK, it doesn't wake up RNG thread automatically,
- *         it is needed to call neug_kick_filling later.
+ * @brief  Instantiate the DRBG by the words ready in the ring buffer,
+ *         without waiting.  The words are kept until enough entropy is
+ *         collected, so that each call makes progress.
+ * @return 0 when the DRBG is seeded, -1 when it needs more words.
  */
-uint32_t neug_get (int kick)
+int neug_drbg_try_seed (void)
 {
-  struct rng_rb *rb = &the_ring_buffer;
-  uint32_t v;
+  uint16_t credit = rng_credit;
+  int words;
+
+  if (drbg_seeded)
+  {
+    return 0;
+  }
 
-  rt_mutex_take(&rb->m, RT_WAITING_FOREVER);
-  while (rb->empty)
+  if (credit == 0)
   {
-    rt_mutex_release(&rb->m);
+    return -1;
+  }
 
-    /* wait until data available */
-    rt_event_recv(&rb->available_state, RNG_DATA_AVAILABLE, 
-        RT_EVENT_FLAG_AND|RT_EVENT_FLAG_CLEAR, RT_WAITING_FOREVER, NULL);
+  words = (DRBG_SEED_BITS * 100 + credit - 1) / credit;
+  if (words > DRBG_SEED_WORDS)
+  {
+    return -1;
+  }
 
-    rt_mutex_take(&rb->m, RT_WAITING_FOREVER);
+  RNG_LOCK (&drbg_m);
+#ifdef PKG_USING_NEUG_DRBG_POOLS
+  pool_active = 1;
+#endif
+#ifdef PKG_USING_NEUG_SEED_FILE
+  if (!drbg_seeded)
+  {
+    neug_seed_restore ();
   }
+#endif
+  while (!drbg_seeded && drbg_seed_len < words)
+  {
+    if (neug_get_nonblock (&drbg_seed_buf[drbg_seed_len]) < 0)
+    {
+      break;
+    }
 
-  v = rb_del (rb);
+    drbg_seed_len++;
+  }
 
-  rt_mutex_release(&rb->m);
+  if (!drbg_seeded && drbg_seed_len >= words)
+  {
+    neug_drbg_input (drbg_seed_buf, drbg_seed_len);
+  }
 
-  if (kick)
+  if (drbg_seeded)
   {
-    /* notify space available event */
-    rt_event_send(&rb->available_state, RNG_SPACE_AVAILABLE);
+    memset (drbg_seed_buf, 0, sizeof drbg_seed_buf);
+    drbg_seed_len = 0;
   }
 
-  return v;
+  RNG_UNLOCK (&drbg_m);
+  return drbg_seeded ? 0 : -1;
 }
 
-int neug_get_nonblock (uint32_t *p)
+#ifdef PKG_USING_NEUG_DRBG_POOLS
+/*
+ * Reseed the DRBG from the pools.  The digests of the pools used are
+ * hashed into the entropy input.  Called with drbg_m held.  Return -1
+ * when pool 0 doesn't have enough inputs yet.
+ */
+static int neug_drbg_pool_reseed (void)
 {
-  struct rng_rb *rb = &the_ring_buffer;
-  int r = 0;
+  tiny_sha2_context sha;
+  uint8_t digest[32];
+  uint32_t r;
+  int i;
 
-  rt_mutex_take(&rb->m, RT_WAITING_FOREVER);
-  if (rb->empty)
+  RNG_LOCK (&pool_m);
+  if (pool_bytes[0] < NEUG_POOL_MIN_BYTES)
   {
-    r = -1;
-    /* notify space available event */
-    rt_event_send(&rb->available_state, RNG_SPACE_AVAILABLE);
+    RNG_UNLOCK (&pool_m);
+    return -1;
   }
-  else
+
+  r = ++pool_reseeds;
+  tiny_sha2_starts (&sha, 0);
+  for (i = 0; i < NEUG_DRBG_POOLS; i++)
   {
-    *p = rb_del (rb);
+    if (i > 0 && (r & (1UL << (i - 1))) != 0)
+    {
+      break;			/* 2^I doesn't divide R.  */
+    }
+
+    tiny_sha2_finish (&pool_ctx[i], digest);
+    tiny_sha2_update (&sha, digest, sizeof digest);
+    tiny_sha2_starts (&pool_ctx[i], 0);
+    pool_bytes[i] = 0;
   }
+  RNG_UNLOCK (&pool_m);
 
-  rt_mutex_release(&rb->m);
+  tiny_sha2_finish (&sha, digest);
+  drbg_reseed (&neug_drbg, digest, sizeof digest);
+  drbg_requests = 0;
 
-  return r;
+  memset (digest, 0, sizeof digest);
+  memset (&sha, 0, sizeof sha);
+  return 0;
 }
+#endif
+#endif
 
 /**
- * @brief  Wakes up RNG thread to generate random numbers.
+ * @brief  Get LEN bytes of random into BUF, by the class CLS.
+ * @detail NEUG_CLASS_FULL_ENTROPY takes conditioned data from the ring
+ *         buffer, waiting for the noise source.  It's only available
+ *         when the conditioned data is credited as full entropy.
+ *         NEUG_CLASS_DRBG_PR reseeds the DRBG for each request,
+ *         waiting for 384-bit of entropy, before it locks the DRBG.
+ *         NEUG_CLASS_DRBG never waits for the noise source (but for
+ *         the first seed), it reseeds after NEUG_DRBG_RESEED_INTERVAL
+ *         requests, when entropy is available.
+ * @return LEN on success, -1 on error.
  */
-void neug_kick_filling (void)
+int neug_read (int cls, void *buf, int len)
 {
-  struct rng_rb *rb = &the_ring_buffer;
+  uint8_t *p = (uint8_t *)buf;
+  int n;
+
+  if (cls == NEUG_CLASS_FULL_ENTROPY)
+  {
+    if (rng_credit < WORD_FULL_ENTROPY)
+    {
+      return -1;
+    }
+
+    n = len;
+    if (((uintptr_t)p & 3) == 0)
+    {
+      /* Whole words at once, into BUF directly.  */
+      neug_get_words ((uint32_t *)p, len / 4);
+      p += len & ~3;
+      n = len & 3;
+    }
+
+    for (; n > 0; n -= 4)
+    {
+      uint32_t v = neug_get (NEUG_KICK_FILLING);
 
-  rt_mutex_take(&rb->m, RT_WAITING_FOREVER);
+      memcpy (p, &v, n < 4 ? n : 4);
+      p += 4;
+    }
 
-  if (!rb->full)
+    return len;
+  }
+#ifdef PKG_USING_NEUG_DRBG
+  else if (cls == NEUG_CLASS_DRBG_PR || cls == NEUG_CLASS_DRBG)
   {
-    /* notify space available event */
-    rt_event_send(&rb->available_state, RNG_SPACE_AVAILABLE);
+    uint32_t seed[DRBG_SEED_WORDS];
+    int words = 0;
+
+    /* Not holding drbg_m, so that NEUG_CLASS_DRBG doesn't wait.  */
+    if (cls == NEUG_CLASS_DRBG_PR)
+    {
+      words = neug_take_entropy (seed, DRBG_SEED_BITS, 1);
+      if (words < 0)
+      {
+        return -1;
+      }
+    }
+
+    RNG_LOCK (&drbg_m);
+#ifdef PKG_USING_NEUG_DRBG_POOLS
+    pool_active = 1;
+#endif
+#ifdef PKG_USING_NEUG_SEED_FILE
+    if (!drbg_seeded)
+    {
+      neug_seed_restore ();
+    }
+#endif
+    if (cls == NEUG_CLASS_DRBG_PR)
+    {
+      neug_drbg_input (seed, words);
+      memset (seed, 0, words * 4);
+    }
+    else if (!drbg_seeded)
+    {
+      if (neug_drbg_seed (1) < 0)
+      {
+        RNG_UNLOCK (&drbg_m);
+        return -1;
+      }
+    }
+    else if (drbg_stale || drbg_requests >= NEUG_DRBG_RESEED_INTERVAL)
+    {
+      /* Keep using the current state, when not available.  */
+#ifdef PKG_USING_NEUG_DRBG_POOLS
+      if (!drbg_stale)
+      {
+        neug_drbg_pool_reseed ();
+      }
+      else
+#endif
+      neug_drbg_seed (0);
+    }
+
+    for (n = len; n > 0; n -= DRBG_MAX_REQUEST)
+    {
+      drbg_generate (&neug_drbg, p, n < DRBG_MAX_REQUEST ? n : DRBG_MAX_REQUEST);
+      p += DRBG_MAX_REQUEST;
+    }
+
+    drbg_requests++;
+
+    RNG_UNLOCK (&drbg_m);
+    return len;
   }
+#endif
 
-  rt_mutex_release(&rb->m);
+  return -1;
 }
 
-void neug_wait_full (void)
+/**
+ * @brief  Wakes up RNG thread to generate random numbers.
+ */
+void neug_kick_filling (void)
 {
-  struct rng_rb *rb = &the_ring_buffer;
+#ifdef PKG_USING_NEUG_PULL
+  /* Fill the ring buffer now.  */
+  neug_wait_full ();
+#else
+  int i;
 
-  rt_mutex_take(&rb->m, RT_WAITING_FOREVER);
-  while (!rb->full)
+  for (i = 0; i < rng_shards; i++)
   {
-    rt_mutex_release(&rb->m);
+    struct rng_rb *rb = &the_ring_buffer[i];
+    int full;
 
-    /* wait until data available */
-    rt_event_recv(&rb->available_state, RNG_DATA_AVAILABLE, 
-        RT_EVENT_FLAG_AND|RT_EVENT_FLAG_CLEAR, RT_WAITING_FOREVER, NULL);
+    RNG_LOCK (&rb->m);
+    full = rb->full;
+    RNG_UNLOCK (&rb->m);
 
-    rt_mutex_take(&rb->m, RT_WAITING_FOREVER);
+    if (!full)
+    {
+      /* notify space available event */
+      RNG_SEND (&rng_state, RNG_SPACE_AVAILABLE);
+      break;
+    }
   }
+#endif
+}
+
+/**
+ * @brief  Wait until all shards are full.
+ */
+void neug_wait_full (void)
+{
+#ifndef PKG_USING_NEUG_PULL
+  rt_uint8_t boost;
+#endif
+  int i;
+
+  for (i = 0; i < rng_shards; i++)
+  {
+    struct rng_rb *rb = &the_ring_buffer[i];
 
-  rt_mutex_release(&rb->m);
+    RNG_LOCK (&rb->m);
+    while (!rb->full)
+    {
+      RNG_UNLOCK (&rb->m);
+
+      /* wait until data available */
+      NEUG_TRACE_BEGIN (NEUG_TRACE_CONSUMER);
+#ifdef PKG_USING_NEUG_PULL
+      rng_step ();
+#else
+      boost = rng_boost_enter ();
+      rt_event_recv(&rb->available_state, RNG_DATA_AVAILABLE, 
+          RT_EVENT_FLAG_AND|RT_EVENT_FLAG_CLEAR, RT_WAITING_FOREVER, NULL);
+      rng_boost_leave (boost);
+#endif
+      NEUG_TRACE_END (NEUG_TRACE_CONSUMER);
+
+      RNG_LOCK (&rb->m);
+    }
+
+    RNG_UNLOCK (&rb->m);
+  }
 }
 
 /**
@@ -967,18 +3945,23 @@ void neug_wait_full (void)
  */
 void neug_flush (void)
 {
-  struct rng_rb *rb = &the_ring_buffer;
+  int i;
 
-  rt_mutex_take(&rb->m, RT_WAITING_FOREVER);
-  while (!rb->empty)
+  for (i = 0; i < rng_shards; i++)
   {
-    (void)rb_del (rb);
-  }
+    struct rng_rb *rb = &the_ring_buffer[i];
+
+    RNG_LOCK (&rb->m);
+    while (rb_avail (rb) > 0)
+    {
+      (void)rb_del (rb);
+    }
 
-  rt_mutex_release(&rb->m);
+    RNG_UNLOCK (&rb->m);
+  }
 
   /* notify space available event */
-  rt_event_send(&rb->available_state, RNG_SPACE_AVAILABLE);
+  RNG_SEND (&rng_state, RNG_SPACE_AVAILABLE);
 }
 
 void neug_mode_select (uint8_t mode)
@@ -988,16 +3971,24 @@ void neug_mode_select (uint8_t mode)
     return;
   }
 
+#ifdef PKG_USING_NEUG_PULL
+  neug_mode = mode;
+  neug_flush ();
+
+  /* Next round starts the noise source in MODE.  */
+  rng_step ();
+#else
   neug_wait_full ();
 
-  rt_mutex_take(&mode_mtx, RT_WAITING_FOREVER);
+  RNG_LOCK (&mode_mtx);
   neug_mode = mode;
   neug_flush ();
-  rt_mutex_release(&mode_mtx);
+  RNG_UNLOCK (&mode_mtx);
 
   /* wait until mode condition event */
   rt_event_recv(&mode_cond, MODE_CONDITION, 
       RT_EVENT_FLAG_AND|RT_EVENT_FLAG_CLEAR, RT_WAITING_FOREVER, NULL);
+#endif
 
   neug_wait_full ();
   neug_flush ();
@@ -1005,30 +3996,65 @@ void neug_mode_select (uint8_t mode)
 
 int neug_consume_random (void (*proc) (uint32_t, int))
 {
-  struct rng_rb *rb = &the_ring_buffer;
-  int i = 0;
+  int i = 0, j;
   uint32_t v;
 
-  rt_mutex_take(&rb->m, RT_WAITING_FOREVER);
-  while (!rb->empty)
+  for (j = 0; j < rng_shards; j++)
   {
+    struct rng_rb *rb = &the_ring_buffer[j];
+
+    RNG_LOCK (&rb->m);
+    while (rb_avail (rb) > 0)
+    {
+      v = rb_del (rb);
+      proc (v, i);
+      i++;
+    }
 
-    v = rb_del (rb);
-    proc (v, i);
-    i++;
+    RNG_UNLOCK (&rb->m);
   }
 
-  rt_mutex_release(&rb->m);
   /* notify space available event */
-  rt_event_send(&rb->available_state, RNG_SPACE_AVAILABLE);
+  RNG_SEND (&rng_state, RNG_SPACE_AVAILABLE);
 
   return i;
 }
 
+#ifdef PKG_USING_NEUG_SEED_FILE
+/**
+ * @brief  Save an output of conditioned data to the seed file.
+ * @return 0 on success, -1 on error.
+ */
+int neug_seed_save (void)
+{
+  uint8_t seed[NEUG_SEED_SIZE];
+  int r = -1;
+
+  if (neug_read (NEUG_CLASS_FULL_ENTROPY, seed, sizeof seed) == sizeof seed)
+  {
+    r = neug_seed_write (seed);
+  }
+
+  memset (seed, 0, sizeof seed);
+  return r;
+}
+#endif
+
+/**
+ * @brief  Stop NeuG, for all callers.  It's not started again by
+ *         neug_init, as the rng thread may still use its objects.
+ */
 void neug_fini (void)
 {
+#ifdef PKG_USING_NEUG_SEED_FILE
+  neug_seed_save ();
+#endif
+#ifdef PKG_USING_NEUG_PULL
+  adc_stop ();
+#else
   rng_should_terminate = 1;
   neug_get (1);
+#endif
   crc32_rv_stop ();
 }
 
@@ -0,0 +1,382 @@
+/*
+ * neug_trace.c - timeline of the generator, in Chrome trace format
+ *
+ * This file is a part of NeuG, a True Random Number Generator
+ * implementation based on quantization error of ADC (for STM32F103).
+ *
+ * NeuG is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NeuG is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <rtthread.h>
+#include <rthw.h>
+
+#ifdef PKG_USING_NEUG_TRACE
+#if defined(__linux__)
+#include <signal.h>
+#include <time.h>
+#endif
+
+#include "neug_trace.h"
+
+/*
+ * Each thread records its events into its own buffer, so recording
+ * takes no lock: a buffer has a single writer, which stores the event
+ * and then advances HEAD.  A buffer is claimed at the first event of
+ * a thread.  When it's full, older events are overwritten.  When the
+ * thread exits, the buffer is released by its cleanup; its events are
+ * kept for the dump until the buffer is claimed by another thread.
+ */
+#ifndef NEUG_TRACE_THREADS
+#define NEUG_TRACE_THREADS 4
+#endif
+
+#ifndef NEUG_TRACE_EVENTS
+#define NEUG_TRACE_EVENTS 128
+#endif
+
+/*
+ * Dump into this file on the signal, on GNU/Linux, once the application
+ * calls neug_trace_install_signal.
+ */
+#if defined(__linux__) && !defined(NEUG_TRACE_SIGNAL)
+#define NEUG_TRACE_SIGNAL SIGUSR2
+#endif
+
+#ifndef NEUG_TRACE_FILE
+#define NEUG_TRACE_FILE "neug-trace.json"
+#endif
+
+/*
+ * Clock of the events, a free-running 32-bit counter at
+ * NEUG_TRACE_CLOCK_HZ.  A port can define NEUG_TRACE_CLOCK_PORT and
+ * implement neug_trace_clock by a cycle counter or a hardware timer,
+ * and NEUG_TRACE_CLOCK_HZ by its rate.  Without it, it's microseconds
+ * on GNU/Linux, and the tick of RT-Thread, too coarse for the spans of
+ * the generator.  The dump places an event by its age, so an event
+ * older than half a wrap of the counter (2^31 / NEUG_TRACE_CLOCK_HZ
+ * seconds) is misplaced.
+ */
+#ifdef NEUG_TRACE_CLOCK_PORT
+#ifndef NEUG_TRACE_CLOCK_HZ
+#error "NEUG_TRACE_CLOCK_PORT needs NEUG_TRACE_CLOCK_HZ"
+#endif
+#elif defined(__linux__)
+#define NEUG_TRACE_CLOCK_HZ 1000000
+#else
+#define NEUG_TRACE_CLOCK_HZ RT_TICK_PER_SECOND
+#endif
+
+struct trace_event {
+  uint32_t ts;			/* by trace_clock */
+  uint8_t ev;
+  char ph;
+};
+
+struct trace_buf {
+  rt_thread_t owner;		/* RT_NULL when released */
+  void (*cleanup) (struct rt_thread *tid);	/* of the owner, chained */
+  char name[RT_NAME_MAX + 1];
+  volatile uint32_t head;
+  struct trace_event ev[NEUG_TRACE_EVENTS];
+};
+
+static struct trace_buf trace_buf[NEUG_TRACE_THREADS];
+static volatile int trace_dump_pending;
+
+static const char *const trace_name[NEUG_TRACE_EVENT_NUM] = {
+  "adc", "filter", "condition", "publish",
+  "ring-full", "mode", "discard", "consumer-wait"
+};
+
+static uint32_t trace_clock (void)
+{
+#if defined(NEUG_TRACE_CLOCK_PORT)
+  return neug_trace_clock ();
+#elif defined(__linux__)
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+#else
+  return rt_tick_get ();
+#endif
+}
+
+/* Age of the event at TS, 0 when it's recorded after NOW.  */
+static uint32_t trace_age (uint32_t now, uint32_t ts)
+{
+  uint32_t age = now - ts;
+
+  return (int32_t)age < 0 ? 0 : age;
+}
+
+/* Called when the thread exits, release its buffer.  */
+static void trace_thread_cleanup (struct rt_thread *tid)
+{
+  void (*cleanup) (struct rt_thread *tid) = RT_NULL;
+  rt_base_t level;
+  int i;
+
+  level = rt_hw_interrupt_disable ();
+  for (i = 0; i < NEUG_TRACE_THREADS; i++)
+  {
+    if (trace_buf[i].owner == tid)
+    {
+      cleanup = trace_buf[i].cleanup;
+      trace_buf[i].owner = RT_NULL;
+      break;
+    }
+  }
+  rt_hw_interrupt_enable (level);
+
+  if (cleanup)
+  {
+    cleanup (tid);
+  }
+}
+
+static struct trace_buf *trace_buf_get (void)
+{
+  rt_thread_t self = rt_thread_self ();
+  struct trace_buf *tb = RT_NULL;
+  rt_base_t level;
+  int i;
+
+  for (i = 0; i < NEUG_TRACE_THREADS; i++)
+  {
+    if (trace_buf[i].owner == self)
+    {
+      return &trace_buf[i];
+    }
+  }
+
+  /*
+   * First event of the thread.  Take an unused buffer, or else, one
+   * released by an exited thread.
+   */
+  level = rt_hw_interrupt_disable ();
+  for (i = 0; i < NEUG_TRACE_THREADS; i++)
+  {
+    if (trace_buf[i].owner == RT_NULL
+        && (trace_buf[i].head == 0 || tb == RT_NULL))
+    {
+      tb = &trace_buf[i];
+    }
+  }
+
+  if (tb)
+  {
+    tb->owner = self;
+    tb->head = 0;
+    rt_strncpy (tb->name, self->name, RT_NAME_MAX);
+    tb->name[RT_NAME_MAX] = '\0';
+    tb->cleanup = self->cleanup;
+    self->cleanup = trace_thread_cleanup;
+  }
+  rt_hw_interrupt_enable (level);
+
+  return tb;
+}
+
+void neug_trace_event (int ev, char ph)
+{
+  struct trace_buf *tb = trace_buf_get ();
+  struct trace_event *e;
+
+  if (tb == RT_NULL)
+  {
+    return;			/* No buffer left for this thread.  */
+  }
+
+  e = &tb->ev[tb->head % NEUG_TRACE_EVENTS];
+  e->ts = trace_clock ();
+  e->ev = ev;
+  e->ph = ph;
+
+  /* The event must be stored before HEAD is advanced.  */
+#if defined(__GNUC__)
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+#endif
+  tb->head++;
+}
+
+void neug_trace_reset (void)
+{
+  int i;
+
+  for (i = 0; i < NEUG_TRACE_THREADS; i++)
+  {
+    trace_buf[i].head = 0;
+  }
+}
+
+static void trace_out (FILE *fp, const char *s)
+{
+  if (fp)
+  {
+    fputs (s, fp);
+  }
+  else
+  {
+    rt_kprintf ("%s", s);
+  }
+}
+
+/*
+ * Dump the events in Chrome trace event format (JSON), which can be
+ * loaded by chrome://tracing or Perfetto.  With PATH == NULL, it's
+ * printed on the console.  The time is in microseconds from the
+ * oldest event.
+ * Return 0 on success, -1 when the file can't be opened.
+ */
+int neug_trace_dump (const char *path)
+{
+  FILE *fp = RT_NULL;
+  char line[128];
+  const char *sep = "";
+  uint32_t now = trace_clock ();
+  uint32_t oldest = 0;
+  int i;
+
+  if (path)
+  {
+    fp = fopen (path, "w");
+    if (fp == RT_NULL)
+    {
+      return -1;
+    }
+  }
+
+  /* Age of the oldest event, by which others are placed.  */
+  for (i = 0; i < NEUG_TRACE_THREADS; i++)
+  {
+    struct trace_buf *tb = &trace_buf[i];
+    uint32_t head = tb->head;
+
+    if (head > 0)
+    {
+      uint32_t j = head > NEUG_TRACE_EVENTS ? head - NEUG_TRACE_EVENTS : 0;
+      uint32_t age = trace_age (now, tb->ev[j % NEUG_TRACE_EVENTS].ts);
+
+      if (age > oldest)
+      {
+        oldest = age;
+      }
+    }
+  }
+
+  trace_out (fp, "{\"traceEvents\":[\n");
+
+  for (i = 0; i < NEUG_TRACE_THREADS; i++)
+  {
+    struct trace_buf *tb = &trace_buf[i];
+    uint32_t head = tb->head;
+    uint32_t j = head > NEUG_TRACE_EVENTS ? head - NEUG_TRACE_EVENTS : 0;
+
+    if (head == 0)
+    {
+      continue;
+    }
+
+    rt_snprintf (line, sizeof line,
+                 "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                 "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                 sep, i + 1, tb->name);
+    trace_out (fp, line);
+    sep = ",\n";
+
+    for (; j < head; j++)
+    {
+      struct trace_event *e = &tb->ev[j % NEUG_TRACE_EVENTS];
+      uint32_t t = oldest - trace_age (now, e->ts);
+      uint64_t ns = (uint64_t)t * 1000000000 / NEUG_TRACE_CLOCK_HZ;
+
+      rt_snprintf (line, sizeof line,
+                   "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%u.%03u,"
+                   "\"pid\":1,\"tid\":%d%s}",
+                   sep, trace_name[e->ev], e->ph,
+                   (unsigned int)(ns / 1000), (unsigned int)(ns % 1000), i + 1,
+                   e->ph == 'i' ? ",\"s\":\"t\"" : "");
+      trace_out (fp, line);
+    }
+  }
+
+  trace_out (fp, "\n]}\n");
+
+  if (fp)
+  {
+    fclose (fp);
+  }
+
+  return 0;
+}
+
+#ifdef NEUG_TRACE_SIGNAL
+static void trace_signal_handler (int sig)
+{
+  (void)sig;
+  trace_dump_pending = 1;
+}
+#endif
+
+/**
+ * @brief  Install the handler of NEUG_TRACE_SIGNAL, which dumps the
+ *         events into NEUG_TRACE_FILE.  It replaces the handler of the
+ *         application, so it's only installed on request.
+ * @return 0 on success, -1 when the signal is not available.
+ */
+int neug_trace_install_signal (void)
+{
+#ifdef NEUG_TRACE_SIGNAL
+  return signal (NEUG_TRACE_SIGNAL, trace_signal_handler) == SIG_ERR ? -1 : 0;
+#else
+  return -1;
+#endif
+}
+
+/*
+ * Called by the rng thread in its loop.  The dump requested by the
+ * signal is done here, out of the signal handler.
+ */
+void neug_trace_poll (void)
+{
+  if (trace_dump_pending)
+  {
+    trace_dump_pending = 0;
+    neug_trace_dump (NEUG_TRACE_FILE);
+  }
+}
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+
+static void neug_trace (int argc, char **argv)
+{
+  if (argc > 1 && !strcmp (argv[1], "reset"))
+  {
+    neug_trace_reset ();
+  }
+  else if (neug_trace_dump (argc > 1 ? argv[1] : RT_NULL) < 0)
+  {
+    rt_kprintf ("neug_trace: can't open %s\n", argv[1]);
+  }
+}
+
+MSH_CMD_EXPORT(neug_trace, dump NeuG trace: neug_trace [file|reset]);
+#endif
+#endif
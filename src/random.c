@@ -29,31 +29,219 @@
 
 #include "random.h"
 #include "neug.h"
+#if defined(PKG_USING_NEUG_DEVICE) && defined(RT_USING_DEVICE)
+#include "neug-dev.h"
+#endif
 
 #define RANDOM_BYTES_LENGTH 32
-static uint32_t random_word[RANDOM_BYTES_LENGTH/sizeof (uint32_t)];
+#define RANDOM_WORDS (RANDOM_BYTES_LENGTH/sizeof (uint32_t))
 
+/*
+ * The ring buffer of NeuG has RANDOM_WORDS for each shard, one shard
+ * for each CPU with RT_USING_SMP.
+ */
+#if defined(RT_USING_SMP) && !defined(PKG_USING_NEUG_PULL)
+#define RANDOM_RING_WORDS (RANDOM_WORDS * RT_CPUS_NR)
+#else
+#define RANDOM_RING_WORDS RANDOM_WORDS
+#endif
+static uint32_t random_word[RANDOM_RING_WORDS];
+
+/*
+ * Slots of 32-byte, handed out by random_bytes_get.  A free slot is
+ * refilled in background by the refill thread, word by word, and what
+ * is not filled yet is filled on demand.  In pull mode, where nobody
+ * runs the generator in background, it's refilled as far as words are
+ * available without waiting.
+ */
+#ifndef NEUG_RANDOM_SLOTS
+#define NEUG_RANDOM_SLOTS 4
+#endif
+
+#ifndef NEUG_RANDOM_REFILL_PRIORITY
+#define NEUG_RANDOM_REFILL_PRIORITY (RT_THREAD_PRIORITY_MAX - 2)
+#endif
+
+#define SLOT_EMPTY  0
+#define SLOT_READY  1
+#define SLOT_LEASED 2
+
+static uint32_t random_slot[NEUG_RANDOM_SLOTS][RANDOM_WORDS];
+static uint8_t random_slot_state[NEUG_RANDOM_SLOTS];
+static uint8_t random_slot_fill[NEUG_RANDOM_SLOTS];
+static struct rt_mutex random_slot_m;
+static struct rt_semaphore random_slot_free;
+#ifndef PKG_USING_NEUG_PULL
+static struct rt_semaphore random_refill_sem;
+static volatile int random_refill_stop;
+static volatile int random_refill_off;	/* By random_refill_enable */
+
+static void random_refill (void *arg);
+#endif
+
+/*
+ * Start NeuG.  The warm-up is done by the rng thread in background,
+ * consumers before the end of warm-up wait for the data.
+ */
 int random_init (void)
 {
-  int i;
+#ifndef PKG_USING_NEUG_PULL
+  rt_thread_t t;
+#endif
+
+  rt_mutex_init (&random_slot_m, "rnd_slot", RT_IPC_FLAG_FIFO);
+  rt_sem_init (&random_slot_free, "rnd_slot", NEUG_RANDOM_SLOTS,
+               RT_IPC_FLAG_FIFO);
 
-  neug_init (random_word, RANDOM_BYTES_LENGTH/sizeof (uint32_t));
+  if (neug_init (random_word, RANDOM_RING_WORDS) < 0)
+  {
+    return -1;
+  }
 
-  for (i = 0; i < NEUG_PRE_LOOP; i++)
+#ifndef PKG_USING_NEUG_PULL
+  /* All slots are empty at start.  */
+  rt_sem_init (&random_refill_sem, "rnd_fill", 1, RT_IPC_FLAG_FIFO);
+  random_refill_stop = 0;
+  t = rt_thread_create ("rnd_fill", random_refill, RT_NULL, 1024,
+                        NEUG_RANDOM_REFILL_PRIORITY, 32);
+  if (t == RT_NULL)
   {
-    (void)neug_get (NEUG_KICK_FILLING);
+    neug_fini ();
+    return -1;
   }
 
+  rt_thread_startup (t);
+#endif
   return 0;
 }
 
+/*
+ * Return 1 when random bytes are available without the warm-up wait
+ */
+int random_is_ready (void)
+{
+  return neug_is_ready ();
+}
+
+/*
+ * Wait for the end of warm-up, at most TIMEOUT ticks
+ * (RT_WAITING_FOREVER to wait forever).
+ * Return 0 on success, -1 on timeout.
+ */
+int random_wait_ready (int32_t timeout)
+{
+  return neug_wait_ready (timeout);
+}
+
+#ifdef PKG_USING_NEUG_PULL
+/*
+ * Fill the slot I without waiting, as far as words are available.
+ * Called with random_slot_m held.
+ */
+static void random_slot_refill (int i)
+{
+  while (random_slot_fill[i] < RANDOM_WORDS)
+  {
+    if (neug_get_nonblock (&random_slot[i][random_slot_fill[i]]) < 0)
+    {
+      return;
+    }
+
+    random_slot_fill[i]++;
+  }
+
+  random_slot_state[i] = SLOT_READY;
+}
+#else
+/*
+ * Refill thread: fill the empty slots, when a slot is freed.  A word
+ * is taken from NeuG without the lock, so it may wait for the noise
+ * source; it's stored only if the slot is still empty, not leased
+ * meanwhile by random_bytes_get (which fills the rest by itself).
+ */
+static void random_refill (void *arg)
+{
+  uint32_t v;
+  int i;
+
+  (void)arg;
+
+  while (1)
+  {
+    rt_sem_take (&random_refill_sem, RT_WAITING_FOREVER);
+
+    for (i = 0; i < NEUG_RANDOM_SLOTS && !random_refill_stop; i++)
+    {
+      while (!random_refill_stop && !random_refill_off)
+      {
+        rt_mutex_take (&random_slot_m, RT_WAITING_FOREVER);
+        if (random_slot_state[i] != SLOT_EMPTY)
+        {
+          rt_mutex_release (&random_slot_m);
+          break;
+        }
+
+        rt_mutex_release (&random_slot_m);
+
+        v = neug_get (NEUG_KICK_FILLING);
+
+        rt_mutex_take (&random_slot_m, RT_WAITING_FOREVER);
+        if (random_slot_state[i] == SLOT_EMPTY)
+        {
+          random_slot[i][random_slot_fill[i]++] = v;
+          if (random_slot_fill[i] == RANDOM_WORDS)
+          {
+            random_slot_state[i] = SLOT_READY;
+          }
+        }
+
+        rt_mutex_release (&random_slot_m);
+      }
+    }
+
+    if (random_refill_stop)
+    {
+      break;
+    }
+  }
+}
+#endif
+
 /*
  * Return pointer to random 32-bytes
  */
 const uint8_t * random_bytes_get (void)
 {
-  neug_wait_full ();
-  return (const uint8_t *)random_word;
+  int i, j = -1;
+
+  /* Wait until a slot is not leased.  */
+  rt_sem_take (&random_slot_free, RT_WAITING_FOREVER);
+
+  rt_mutex_take (&random_slot_m, RT_WAITING_FOREVER);
+  for (i = 0; i < NEUG_RANDOM_SLOTS; i++)
+  {
+    if (random_slot_state[i] == SLOT_READY)
+    {
+      j = i;
+      break;
+    }
+    else if (random_slot_state[i] == SLOT_EMPTY
+             && (j < 0 || random_slot_fill[i] > random_slot_fill[j]))
+    {
+      j = i;
+    }
+  }
+
+  random_slot_state[j] = SLOT_LEASED;
+  rt_mutex_release (&random_slot_m);
+
+  /* The slot is ours now, fill the rest.  */
+  while (random_slot_fill[j] < RANDOM_WORDS)
+  {
+    random_slot[j][random_slot_fill[j]++] = neug_get (NEUG_KICK_FILLING);
+  }
+
+  return (const uint8_t *)random_slot[j];
 }
 
 /*
@@ -61,9 +249,29 @@ const uint8_t * random_bytes_get (void)
  */
 void random_bytes_free (const uint8_t *p)
 {
-  (void)p;
-  memset (random_word, 0, RANDOM_BYTES_LENGTH);
-  neug_flush ();
+  int i = ((const uint32_t *)p - &random_slot[0][0]) / RANDOM_WORDS;
+
+  memset (random_slot[i], 0, RANDOM_BYTES_LENGTH);
+
+  rt_mutex_take (&random_slot_m, RT_WAITING_FOREVER);
+  random_slot_fill[i] = 0;
+  random_slot_state[i] = SLOT_EMPTY;
+
+#ifdef PKG_USING_NEUG_PULL
+  for (i = 0; i < NEUG_RANDOM_SLOTS; i++)
+  {
+    if (random_slot_state[i] == SLOT_EMPTY)
+    {
+      random_slot_refill (i);
+    }
+  }
+#endif
+  rt_mutex_release (&random_slot_m);
+
+#ifndef PKG_USING_NEUG_PULL
+  rt_sem_release (&random_refill_sem);
+#endif
+  rt_sem_release (&random_slot_free);
 }
 
 /*
@@ -87,28 +295,32 @@ int random_gen (void *arg, unsigned char *out, size_t out_len)
   uint8_t *index_p = (uint8_t *)arg;
   uint8_t index = *index_p;
   size_t n;
+  uint32_t v;
+
+  index = (index + out_len) % RANDOM_BYTES_LENGTH;
+  if (((uintptr_t)out & 3) == 0 && out_len >= sizeof (uint32_t))
+  {
+    /* Whole words at once, into OUT directly.  */
+    n = out_len / sizeof (uint32_t);
+    neug_get_words ((uint32_t *)out, n);
+    out += n * sizeof (uint32_t);
+    out_len -= n * sizeof (uint32_t);
+  }
 
   while (out_len)
   {
-    neug_wait_full ();
+    v = neug_get (NEUG_KICK_FILLING);
 
     /* get the length of data,which will be fill in out buffer */
-    n = RANDOM_BYTES_LENGTH - index;
+    n = sizeof (uint32_t);
     if (n > out_len)
     {
       n = out_len;
     }
 
-    memcpy (out, ((unsigned char *)random_word) + index, n);
+    memcpy (out, &v, n);
     out += n;
     out_len -= n;
-    index += n;
-
-    if (index >= RANDOM_BYTES_LENGTH)
-    {
-      index = 0;
-      neug_flush ();
-    }
   }
 
   *index_p = index;
@@ -116,8 +328,34 @@ int random_gen (void *arg, unsigned char *out, size_t out_len)
   return 0;
 }
 
+/*
+ * Enable (ON != 0) or disable the background refill of the slots, so
+ * that a measurement of NeuG sees all of its output.  While disabled,
+ * a slot is filled by random_bytes_get.  A word being taken by the
+ * refill thread when it's disabled is still stored.
+ */
+void random_refill_enable (int on)
+{
+#ifndef PKG_USING_NEUG_PULL
+  random_refill_off = !on;
+  if (on)
+  {
+    rt_sem_release (&random_refill_sem);
+  }
+#else
+  (void)on;
+#endif
+}
+
 void random_fini (void)
 {
+#if defined(PKG_USING_NEUG_DEVICE) && defined(RT_USING_DEVICE)
+  neug_dev_unregister ();
+#endif
+#ifndef PKG_USING_NEUG_PULL
+  random_refill_stop = 1;
+  rt_sem_release (&random_refill_sem);
+#endif
   neug_fini ();
 }
 
@@ -0,0 +1,175 @@
+/*
+ * seed.c - seed file of NeuG
+ *
+ * This file is a part of NeuG, a True Random Number Generator
+ * implementation based on quantization error of ADC (for STM32F103).
+ *
+ * NeuG is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NeuG is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include <rtthread.h>
+
+#if defined(PKG_USING_NEUG_SEED_FILE) && !defined(NEUG_SEED_PORT)
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "seed.h"
+
+#ifndef NEUG_SEED_FILE
+#define NEUG_SEED_FILE "/neug.seed"
+#endif
+
+#define SEED_MAGIC "NeuGseed"
+#define SEED_MAGIC_SIZE 8
+
+static int seed_read_file (const char *path, uint8_t *seed)
+{
+  uint8_t buf[SEED_MAGIC_SIZE + NEUG_SEED_SIZE];
+  int fd, r;
+
+  fd = open (path, O_RDONLY);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  r = read (fd, buf, sizeof buf);
+  close (fd);
+
+  if (r != sizeof buf || memcmp (buf, SEED_MAGIC, SEED_MAGIC_SIZE))
+  {
+    return -1;
+  }
+
+  memcpy (seed, buf + SEED_MAGIC_SIZE, NEUG_SEED_SIZE);
+  memset (buf, 0, sizeof buf);
+  return 0;
+}
+
+/*
+ * Read the seed.  Return 0 on success, -1 when there is no valid seed.
+ * The temporary file is only there when the replace was interrupted,
+ * and it's complete then.
+ */
+int neug_seed_read (uint8_t *seed)
+{
+  if (seed_read_file (NEUG_SEED_FILE, seed) == 0)
+  {
+    return 0;
+  }
+
+  return seed_read_file (NEUG_SEED_FILE ".tmp", seed);
+}
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+
+/*
+ * Flush the directory of the seed file, so that the rename is on the
+ * media.  A file system which can't open or sync a directory (or
+ * doesn't need it) is not an error.
+ */
+static int seed_sync_dir (void)
+{
+  char dir[sizeof NEUG_SEED_FILE];
+  char *p;
+  int fd, r;
+
+  memcpy (dir, NEUG_SEED_FILE, sizeof dir);
+  p = strrchr (dir, '/');
+  if (p == NULL)
+  {
+    strcpy (dir, ".");
+  }
+  else
+  {
+    if (p == dir)
+    {
+      p++;			/* The root */
+    }
+
+    *p = '\0';
+  }
+
+  fd = open (dir, O_RDONLY | O_DIRECTORY);
+  if (fd < 0)
+  {
+    return 0;
+  }
+
+  r = fsync (fd);
+  if (r < 0 && (errno == EINVAL || errno == ENOTSUP || errno == EBADF))
+  {
+    r = 0;
+  }
+
+  close (fd);
+  return r;
+}
+
+/*
+ * Write the seed into a temporary file, and replace the seed file by
+ * rename, so that the seed file is always complete, old or new.
+ * Return 0 on success, -1 on error.
+ */
+int neug_seed_write (const uint8_t *seed)
+{
+  uint8_t buf[SEED_MAGIC_SIZE + NEUG_SEED_SIZE];
+  int fd, r;
+
+  memcpy (buf, SEED_MAGIC, SEED_MAGIC_SIZE);
+  memcpy (buf + SEED_MAGIC_SIZE, seed, NEUG_SEED_SIZE);
+
+  fd = open (NEUG_SEED_FILE ".tmp", O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  r = write (fd, buf, sizeof buf);
+  memset (buf, 0, sizeof buf);
+  if (r != sizeof buf || fsync (fd) < 0)
+  {
+    close (fd);
+    unlink (NEUG_SEED_FILE ".tmp");
+    return -1;
+  }
+
+  close (fd);
+
+  /* Some file systems (FAT) can't rename over an existing file.  */
+  if (rename (NEUG_SEED_FILE ".tmp", NEUG_SEED_FILE) < 0)
+  {
+    if (errno != EEXIST)
+    {
+      unlink (NEUG_SEED_FILE ".tmp");
+      return -1;
+    }
+
+    unlink (NEUG_SEED_FILE);
+    if (rename (NEUG_SEED_FILE ".tmp", NEUG_SEED_FILE) < 0)
+    {
+      return -1;
+    }
+  }
+
+  return seed_sync_dir () < 0 ? -1 : 0;
+}
+#endif
@@ -0,0 +1,202 @@
+/*
+ * sha512.c -- Compute SHA-512 hash
+ *
+ * This file is a part of NeuG, a True Random Number Generator
+ * implementation based on quantization error of ADC (for STM32F103).
+ *
+ * NeuG is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NeuG is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Reference: FIPS 180-4, Secure Hash Standard.
+ * Only full bytes of input are supported, and total input is limited
+ * to 2^64 bits, which is far enough for a conditioner.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <rtthread.h>
+
+#if defined(PKG_USING_NEUG_SHA512) || defined(PKG_NEUG_CONDITIONER_SHA512)
+#include "sha512.h"
+
+static const uint64_t sha512_k[80] = {
+  0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL,
+  0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL,
+  0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL,
+  0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+  0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+  0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL,
+  0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL, 0x2de92c6f592b0275ULL,
+  0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+  0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL,
+  0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+  0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL,
+  0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+  0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL,
+  0x92722c851482353bULL, 0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL,
+  0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+  0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+  0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL,
+  0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL,
+  0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL,
+  0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+  0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL,
+  0xc67178f2e372532bULL, 0xca273eceea26619cULL, 0xd186b8c721c0c207ULL,
+  0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL,
+  0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+  0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+  0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL,
+  0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+};
+
+static const uint64_t sha512_iv[8] = {
+  0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL,
+  0xa54ff53a5f1d36f1ULL, 0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+  0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+#define ROTR(x,n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+#define S0(x) (ROTR (x, 28) ^ ROTR (x, 34) ^ ROTR (x, 39))
+#define S1(x) (ROTR (x, 14) ^ ROTR (x, 18) ^ ROTR (x, 41))
+#define G0(x) (ROTR (x,  1) ^ ROTR (x,  8) ^ ((x) >> 7))
+#define G1(x) (ROTR (x, 19) ^ ROTR (x, 61) ^ ((x) >> 6))
+
+#define CH(x,y,z)  (((x) & (y)) ^ (~(x) & (z)))
+#define MAJ(x,y,z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+
+static uint64_t get_be64 (const uint8_t *p)
+{
+  return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48)
+    | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32)
+    | ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16)
+    | ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+}
+
+static void put_be64 (uint8_t *p, uint64_t v)
+{
+  int i;
+
+  for (i = 7; i >= 0; i--)
+  {
+    p[i] = (uint8_t)v;
+    v >>= 8;
+  }
+}
+
+static void sha512_compress (sha512_context *ctx, const uint8_t *p)
+{
+  uint64_t w[16];
+  uint64_t s[8];
+  uint64_t t1, t2;
+  int i;
+
+  memcpy (s, ctx->state, sizeof s);
+
+  for (i = 0; i < 80; i++)
+  {
+    if (i < 16)
+    {
+      w[i] = get_be64 (p + i * 8);
+    }
+    else
+    {
+      w[i & 15] += G1 (w[(i - 2) & 15]) + w[(i - 7) & 15]
+        + G0 (w[(i - 15) & 15]);
+    }
+
+    t1 = s[7] + S1 (s[4]) + CH (s[4], s[5], s[6]) + sha512_k[i] + w[i & 15];
+    t2 = S0 (s[0]) + MAJ (s[0], s[1], s[2]);
+    s[7] = s[6];
+    s[6] = s[5];
+    s[5] = s[4];
+    s[4] = s[3] + t1;
+    s[3] = s[2];
+    s[2] = s[1];
+    s[1] = s[0];
+    s[0] = t1 + t2;
+  }
+
+  for (i = 0; i < 8; i++)
+  {
+    ctx->state[i] += s[i];
+  }
+}
+
+void sha512_start (sha512_context *ctx)
+{
+  ctx->total = 0;
+  memcpy (ctx->state, sha512_iv, sizeof ctx->state);
+}
+
+void sha512_update (sha512_context *ctx, const uint8_t *input,
+		    unsigned int ilen)
+{
+  unsigned int left = ctx->total & (SHA512_BLOCK_SIZE - 1);
+  unsigned int fill = SHA512_BLOCK_SIZE - left;
+
+  ctx->total += ilen;
+
+  if (left && ilen >= fill)
+  {
+    memcpy (ctx->buffer + left, input, fill);
+    sha512_compress (ctx, ctx->buffer);
+    input += fill;
+    ilen -= fill;
+    left = 0;
+  }
+
+  while (ilen >= SHA512_BLOCK_SIZE)
+  {
+    sha512_compress (ctx, input);
+    input += SHA512_BLOCK_SIZE;
+    ilen -= SHA512_BLOCK_SIZE;
+  }
+
+  if (ilen)
+  {
+    memcpy (ctx->buffer + left, input, ilen);
+  }
+}
+
+void sha512_finish (sha512_context *ctx, uint8_t output[SHA512_DIGEST_SIZE])
+{
+  unsigned int left = ctx->total & (SHA512_BLOCK_SIZE - 1);
+  int i;
+
+  ctx->buffer[left++] = 0x80;
+
+  if (left > SHA512_BLOCK_SIZE - 16)
+  {
+    memset (ctx->buffer + left, 0, SHA512_BLOCK_SIZE - left);
+    sha512_compress (ctx, ctx->buffer);
+    left = 0;
+  }
+
+  /* Length in bits, 128-bit big endian; the upper half is zero.  */
+  memset (ctx->buffer + left, 0, SHA512_BLOCK_SIZE - 8 - left);
+  put_be64 (ctx->buffer + SHA512_BLOCK_SIZE - 8, ctx->total << 3);
+  sha512_compress (ctx, ctx->buffer);
+
+  for (i = 0; i < 8; i++)
+  {
+    put_be64 (output + i * 8, ctx->state[i]);
+  }
+
+  memset (ctx, 0, sizeof (sha512_context));
+}
+#endif
@@ -0,0 +1,856 @@
+/*
+ * shm-pool.c - output pool in shared memory for other processes
+ *
+ * This file is a part of NeuG, a True Random Number Generator
+ * implementation based on quantization error of ADC (for STM32F103).
+ *
+ * NeuG is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NeuG is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include <rtthread.h>
+
+#if defined(PKG_USING_NEUG_SHM_POOL) && defined(__linux__)
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "neug.h"
+#include "shm-pool.h"
+
+/*
+ * The pool object is written only by the producer, consumers map it
+ * read-only; they can't disturb the producer nor each other.  It has
+ * NEUG_SHM_LANES lanes, each is a ring of NEUG_SHM_SLOTS blocks with
+ * HEAD, the blocks written so far, owned by the producer.  Positions
+ * are 64-bit, so they never wrap.
+ *
+ * A consumer takes a free lane K by creating the lane object "NAME.K"
+ * with O_EXCL, and it writes only there: TAIL, the blocks taken so
+ * far.  The producer maps the lane objects read-only, and writes a
+ * block into a lane while HEAD - TAIL < NEUG_SHM_SLOTS.  A block goes
+ * to one lane only, so no two consumers get the same block, and a bad
+ * TAIL only stalls the lane of the consumer which wrote it.  When the
+ * consumer closes the lane or dies, the producer removes the lane
+ * object, and the lane is free again.
+ *
+ * Neither side makes system calls unless it has to sleep: a consumer
+ * on empty lane, and the producer when all lanes are full.  They sleep
+ * on futex, and the other side wakes them only when it sees a sleeper.
+ * The producer sleeps on the doorbell object "NAME.w", the only one
+ * which all consumers write: they bump it before the wake, so that a
+ * wake between its last check and the sleep is not lost.  A bad
+ * consumer can only wake the producer in vain.  The producer looks
+ * for new lanes every SHM_SCAN_MS, and when woken.
+ */
+#ifndef NEUG_SHM_NAME
+#define NEUG_SHM_NAME "/neug"
+#endif
+
+/* Words in a block, a unit of claim.  */
+#ifndef NEUG_SHM_BLOCK
+#define NEUG_SHM_BLOCK 8
+#endif
+
+/* Consumers at once.  */
+#ifndef NEUG_SHM_LANES
+#define NEUG_SHM_LANES 16
+#endif
+
+/* Blocks in a lane.  */
+#ifndef NEUG_SHM_SLOTS
+#define NEUG_SHM_SLOTS 64
+#endif
+
+/* Permission of the shared memory objects.  */
+#ifndef NEUG_SHM_MODE
+#define NEUG_SHM_MODE 0600
+#endif
+
+#define SHM_MAGIC     0x4775654e	/* "NeuG" */
+#define SHM_ACK_MAGIC 0x4c75654e	/* "NeuL" */
+#define SHM_VERSION   3
+
+#define SHM_SCAN_MS 100
+
+/* Name of a lane object, NAME.K.  */
+#define SHM_LANE_NAME_MAX (NAME_MAX + 16)
+
+/* Lane in the first pages of the pool object.  */
+struct shm_lane {
+  uint64_t head;
+  uint32_t pub;			/* futex, bumped for each block */
+} __attribute__ ((aligned (64)));
+
+/* First pages of the pool object, before the blocks.  */
+struct shm_ctl {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t block;
+  uint32_t slots;		/* in a lane */
+  uint32_t lanes;
+  uint32_t offset;		/* of the blocks, page aligned */
+  uint32_t alive;		/* cleared when the producer stops */
+  uint32_t prod_waiting;
+  struct shm_lane lane[];
+};
+
+/* Lane object, written by the consumer.  */
+struct shm_ack {
+  uint32_t magic;		/* set last */
+  int32_t pid;
+  uint64_t tail;
+  uint32_t waiting;		/* the consumer sleeps on PUB of the lane */
+  uint32_t closed;
+};
+
+struct neug_shm {
+  const struct shm_ctl *ctl;	/* whole object, read-only */
+  const uint32_t *data;		/* blocks of the lane */
+  size_t size;
+  struct shm_ack *ack;
+  uint32_t *bell;		/* doorbell of the producer */
+  int lane;
+  uint32_t block;
+  uint32_t slots;
+  uint32_t lanes;
+  unsigned int gen;		/* shm_fork_gen when the lane is taken */
+  int avail;			/* bytes left at the end of CACHE */
+  char name[NAME_MAX];
+  uint8_t cache[];
+};
+
+static int futex (const uint32_t *addr, int op, uint32_t val,
+                  const struct timespec *ts)
+{
+  return syscall (SYS_futex, addr, op, val, ts, NULL, 0);
+}
+
+static void shm_lane_name (char *buf, size_t len, const char *name, int k)
+{
+  snprintf (buf, len, "%s.%d", name, k);
+}
+
+static void shm_bell_name (char *buf, size_t len, const char *name)
+{
+  snprintf (buf, len, "%s.w", name);
+}
+
+/* Wake the producer.  */
+static void shm_ring (uint32_t *bell)
+{
+  __atomic_add_fetch (bell, 1, __ATOMIC_SEQ_CST);
+  futex (bell, FUTEX_WAKE, 1, NULL);
+}
+
+static struct {
+  struct shm_ctl *ctl;
+  uint32_t *bell;
+  uint32_t *data;
+  size_t size;
+  const struct shm_ack *ack[NEUG_SHM_LANES];	/* lanes taken */
+  char name[NAME_MAX];
+} shm_pool;
+
+static rt_thread_t shm_thread;
+static int shm_should_terminate;
+
+static int shm_gone (pid_t pid)
+{
+  return kill (pid, 0) < 0 && errno == ESRCH;
+}
+
+/*
+ * Map the lanes newly taken by consumers, and release the lanes
+ * closed, or left by consumers which died.
+ */
+static void shm_lane_scan (void)
+{
+  char lname[SHM_LANE_NAME_MAX];
+  const struct shm_ack *a;
+  struct stat st;
+  int k, fd;
+
+  for (k = 0; k < NEUG_SHM_LANES; k++)
+  {
+    shm_lane_name (lname, sizeof lname, shm_pool.name, k);
+    if ((a = shm_pool.ack[k]) != RT_NULL)
+    {
+      if (__atomic_load_n (&a->closed, __ATOMIC_SEQ_CST) || shm_gone (a->pid))
+      {
+        /* The blocks left in the lane are never used again.  */
+        munmap ((void *)a, sizeof *a);
+        shm_pool.ack[k] = RT_NULL;
+        shm_unlink (lname);
+      }
+
+      continue;
+    }
+
+    fd = shm_open (lname, O_RDONLY, 0);
+    if (fd < 0)
+    {
+      continue;
+    }
+
+    if (fstat (fd, &st) < 0 || (size_t)st.st_size < sizeof *a
+        || (a = mmap (NULL, sizeof *a, PROT_READ, MAP_SHARED, fd, 0))
+           == MAP_FAILED)
+    {
+      close (fd);
+      continue;
+    }
+
+    close (fd);
+    if (__atomic_load_n (&a->magic, __ATOMIC_ACQUIRE) == SHM_ACK_MAGIC)
+    {
+      if (a->tail == shm_pool.ctl->lane[k].head)
+      {
+        shm_pool.ack[k] = a;
+        continue;
+      }
+
+      /* Left by a consumer of a previous producer.  */
+      if (shm_gone (a->pid))
+      {
+        shm_unlink (lname);
+      }
+    }
+
+    munmap ((void *)a, sizeof *a);
+  }
+}
+
+/* Write a block into the lane K, if it has room.  Return 1 if written.  */
+static int shm_fill (int k)
+{
+  const struct shm_ack *a = shm_pool.ack[k];
+  struct shm_lane *lane = &shm_pool.ctl->lane[k];
+  uint64_t head = lane->head;
+
+  if (a == RT_NULL || __atomic_load_n (&a->closed, __ATOMIC_SEQ_CST)
+      || head - __atomic_load_n (&a->tail, __ATOMIC_SEQ_CST) >= NEUG_SHM_SLOTS)
+  {
+    return 0;
+  }
+
+  neug_get_words (&shm_pool.data[((uint64_t)k * NEUG_SHM_SLOTS
+                                  + head % NEUG_SHM_SLOTS) * NEUG_SHM_BLOCK],
+                  NEUG_SHM_BLOCK);
+  __atomic_store_n (&lane->head, head + 1, __ATOMIC_RELEASE);
+
+  __atomic_add_fetch (&lane->pub, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n (&a->waiting, __ATOMIC_SEQ_CST))
+  {
+    futex (&lane->pub, FUTEX_WAKE, INT_MAX, NULL);
+  }
+
+  return 1;
+}
+
+static int shm_has_room (void)
+{
+  int k;
+
+  for (k = 0; k < NEUG_SHM_LANES; k++)
+  {
+    const struct shm_ack *a = shm_pool.ack[k];
+
+    if (a && shm_pool.ctl->lane[k].head
+             - __atomic_load_n (&a->tail, __ATOMIC_SEQ_CST) < NEUG_SHM_SLOTS)
+    {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static void shm_producer (void *arg)
+{
+  struct shm_ctl *ctl = shm_pool.ctl;
+  struct timespec ts = { 0, SHM_SCAN_MS * 1000 * 1000 };
+  struct timespec now, last = { 0, 0 };
+  char lname[SHM_LANE_NAME_MAX];
+  int k, written;
+
+  (void)arg;
+
+  while (!__atomic_load_n (&shm_should_terminate, __ATOMIC_SEQ_CST))
+  {
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    if ((now.tv_sec - last.tv_sec) * 1000
+        + (now.tv_nsec - last.tv_nsec) / 1000000 >= SHM_SCAN_MS)
+    {
+      shm_lane_scan ();
+      last = now;
+    }
+
+    for (k = written = 0; k < NEUG_SHM_LANES; k++)
+    {
+      written |= shm_fill (k);
+    }
+
+    if (!written)
+    {
+      uint32_t bell;
+
+      /* Full.  Check again after telling consumers, then sleep.  */
+      __atomic_store_n (&ctl->prod_waiting, 1, __ATOMIC_SEQ_CST);
+      bell = __atomic_load_n (shm_pool.bell, __ATOMIC_SEQ_CST);
+      if (!shm_has_room ())
+      {
+        futex (shm_pool.bell, FUTEX_WAIT, bell, &ts);
+      }
+
+      __atomic_store_n (&ctl->prod_waiting, 0, __ATOMIC_SEQ_CST);
+      last.tv_sec = last.tv_nsec = 0;
+    }
+  }
+
+  /*
+   * A consumer which takes a lane after this sees ALIVE cleared, and
+   * removes it by itself.
+   */
+  for (k = 0; k < NEUG_SHM_LANES; k++)
+  {
+    if (shm_pool.ack[k])
+    {
+      munmap ((void *)shm_pool.ack[k], sizeof *shm_pool.ack[k]);
+      shm_pool.ack[k] = RT_NULL;
+    }
+
+    shm_lane_name (lname, sizeof lname, shm_pool.name, k);
+    shm_unlink (lname);
+  }
+
+  shm_bell_name (lname, sizeof lname, shm_pool.name);
+  shm_unlink (lname);
+  munmap (shm_pool.bell, sizeof *shm_pool.bell);
+  munmap (shm_pool.ctl, shm_pool.size);
+  shm_pool.ctl = RT_NULL;
+}
+
+/**
+ * @brief  Publish the output into the shared memory object NAME.
+ * @detail A thread takes the output from the ring buffer and fills
+ *         the lanes taken by consumers.  It fails when NAME exists,
+ *         published by another producer (or left by one which died,
+ *         it must be removed by hand).
+ * @return 0 on success, -1 on error.
+ */
+int neug_shm_publish (const char *name)
+{
+  struct shm_ctl *ctl;
+  uint32_t *bell;
+  char lname[SHM_LANE_NAME_MAX];
+  long page = sysconf (_SC_PAGESIZE);
+  size_t offset, size;
+  int fd, k;
+
+  if (shm_pool.ctl)
+  {
+    return -1;
+  }
+
+  if (name == RT_NULL)
+  {
+    name = NEUG_SHM_NAME;
+  }
+
+  /* Room for the lane number.  */
+  if (strlen (name) + 12 >= sizeof shm_pool.name)
+  {
+    return -1;
+  }
+
+  offset = sizeof (struct shm_ctl) + NEUG_SHM_LANES * sizeof (struct shm_lane);
+  offset = (offset + page - 1) / page * page;
+  size = offset + (size_t)NEUG_SHM_LANES * NEUG_SHM_SLOTS * NEUG_SHM_BLOCK
+                  * sizeof (uint32_t);
+
+  fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, NEUG_SHM_MODE);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  if (ftruncate (fd, size) < 0)
+  {
+    close (fd);
+    shm_unlink (name);
+    return -1;
+  }
+
+  ctl = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (ctl == MAP_FAILED)
+  {
+    shm_unlink (name);
+    return -1;
+  }
+
+  /* NAME is ours, the doorbell may be left by a producer which died.  */
+  shm_bell_name (lname, sizeof lname, name);
+  fd = shm_open (lname, O_RDWR | O_CREAT | O_TRUNC, NEUG_SHM_MODE);
+  if (fd < 0 || ftruncate (fd, sizeof *bell) < 0
+      || (bell = mmap (NULL, sizeof *bell, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0)) == MAP_FAILED)
+  {
+    if (fd >= 0)
+    {
+      close (fd);
+      shm_unlink (lname);
+    }
+
+    munmap (ctl, size);
+    shm_unlink (name);
+    return -1;
+  }
+
+  close (fd);
+
+  /* Lanes left by consumers of a producer which died.  */
+  for (k = 0; k < NEUG_SHM_LANES; k++)
+  {
+    shm_lane_name (lname, sizeof lname, name, k);
+    shm_unlink (lname);
+  }
+
+  ctl->version = SHM_VERSION;
+  ctl->block = NEUG_SHM_BLOCK;
+  ctl->slots = NEUG_SHM_SLOTS;
+  ctl->lanes = NEUG_SHM_LANES;
+  ctl->offset = offset;
+  ctl->alive = 1;
+
+  shm_pool.ctl = ctl;
+  shm_pool.bell = bell;
+  shm_pool.data = (uint32_t *)((uint8_t *)ctl + offset);
+  shm_pool.size = size;
+  memset (shm_pool.ack, 0, sizeof shm_pool.ack);
+  strcpy (shm_pool.name, name);
+  shm_should_terminate = 0;
+
+  shm_thread = rt_thread_create("neug_shm", shm_producer, RT_NULL,
+                                2048, RT_THREAD_PRIORITY_MAX -2, 32);
+  if (shm_thread == RT_NULL)
+  {
+    munmap (bell, sizeof *bell);
+    shm_bell_name (lname, sizeof lname, name);
+    shm_unlink (lname);
+    munmap (ctl, size);
+    shm_unlink (name);
+    shm_pool.ctl = RT_NULL;
+    return -1;
+  }
+
+  /* Consumers can open it now.  */
+  __atomic_store_n (&ctl->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+
+  rt_thread_startup(shm_thread);
+  return 0;
+}
+
+/**
+ * @brief  Stop publishing.
+ * @detail Consumers can take blocks left in their lanes, and then
+ *         their reads return short.  The object is removed, a new
+ *         consumer can't open it.
+ */
+void neug_shm_unpublish (void)
+{
+  struct shm_ctl *ctl = shm_pool.ctl;
+  int k;
+
+  if (ctl == RT_NULL || shm_should_terminate)
+  {
+    return;
+  }
+
+  shm_unlink (shm_pool.name);
+
+  __atomic_store_n (&ctl->alive, 0, __ATOMIC_SEQ_CST);
+  for (k = 0; k < NEUG_SHM_LANES; k++)
+  {
+    __atomic_add_fetch (&ctl->lane[k].pub, 1, __ATOMIC_SEQ_CST);
+    futex (&ctl->lane[k].pub, FUTEX_WAKE, INT_MAX, NULL);
+  }
+
+  shm_ring (shm_pool.bell);
+
+  /* Last, the thread unmaps the object when it sees this.  */
+  __atomic_store_n (&shm_should_terminate, 1, __ATOMIC_SEQ_CST);
+}
+
+/*
+ * Bumped in a forked child, so that a read finds the fork without a
+ * system call.
+ */
+static unsigned int shm_fork_gen;
+static pthread_once_t shm_fork_once = PTHREAD_ONCE_INIT;
+
+static void shm_fork_child (void)
+{
+  shm_fork_gen++;
+}
+
+static void shm_fork_init (void)
+{
+  pthread_atfork (NULL, NULL, shm_fork_child);
+}
+
+/* Take a free lane for SHM.  Return 0 on success, -1 on error.  */
+static int shm_lane_take (struct neug_shm *shm)
+{
+  const struct shm_ctl *ctl = shm->ctl;
+  char lname[SHM_LANE_NAME_MAX];
+  struct shm_ack *ack;
+  int k, fd;
+
+  for (k = 0; k < (int)shm->lanes; k++)
+  {
+    shm_lane_name (lname, sizeof lname, shm->name, k);
+    fd = shm_open (lname, O_RDWR | O_CREAT | O_EXCL, NEUG_SHM_MODE);
+    if (fd < 0)
+    {
+      if (errno == EEXIST)
+      {
+        continue;
+      }
+
+      return -1;
+    }
+
+    if (ftruncate (fd, sizeof *ack) < 0
+        || (ack = mmap (NULL, sizeof *ack, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+      close (fd);
+      shm_unlink (lname);
+      return -1;
+    }
+
+    close (fd);
+    ack->pid = getpid ();
+    /* The producer doesn't write a lane which isn't taken.  */
+    ack->tail = __atomic_load_n (&ctl->lane[k].head, __ATOMIC_ACQUIRE);
+    __atomic_store_n (&ack->magic, SHM_ACK_MAGIC, __ATOMIC_SEQ_CST);
+
+    if (!__atomic_load_n (&ctl->alive, __ATOMIC_SEQ_CST))
+    {
+      /* The producer has gone, nobody else removes it.  */
+      munmap (ack, sizeof *ack);
+      shm_unlink (lname);
+      return -1;
+    }
+
+    shm->ack = ack;
+    shm->lane = k;
+    shm->data = (const uint32_t *)((const uint8_t *)ctl + ctl->offset)
+                + (size_t)k * shm->slots * shm->block;
+    shm->gen = __atomic_load_n (&shm_fork_gen, __ATOMIC_SEQ_CST);
+
+    /* Let the producer find it at once, when it sleeps.  */
+    shm_ring (shm->bell);
+    return 0;
+  }
+
+  return -1;
+}
+
+/**
+ * @brief  Open the pool published as NAME, by another process.
+ * @detail A free lane is taken, it fails when all are taken.
+ * @return The handle, or RT_NULL on error.
+ */
+struct neug_shm *neug_shm_open (const char *name)
+{
+  struct neug_shm *shm;
+  const struct shm_ctl *ctl;
+  char bname[SHM_LANE_NAME_MAX];
+  struct stat st;
+  long page = sysconf (_SC_PAGESIZE);
+  uint32_t block, slots, lanes, offset;
+  int fd;
+
+  if (name == RT_NULL)
+  {
+    name = NEUG_SHM_NAME;
+  }
+
+  pthread_once (&shm_fork_once, shm_fork_init);
+
+  if (strlen (name) + 12 >= sizeof shm->name)
+  {
+    return RT_NULL;
+  }
+
+  fd = shm_open (name, O_RDONLY, 0);
+  if (fd < 0)
+  {
+    return RT_NULL;
+  }
+
+  if (fstat (fd, &st) < 0 || (size_t)st.st_size < (size_t)page)
+  {
+    close (fd);
+    return RT_NULL;
+  }
+
+  ctl = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (ctl == MAP_FAILED)
+  {
+    return RT_NULL;
+  }
+
+  block = ctl->block;
+  slots = ctl->slots;
+  lanes = ctl->lanes;
+  offset = ctl->offset;
+  if (__atomic_load_n (&ctl->magic, __ATOMIC_ACQUIRE) != SHM_MAGIC
+      || ctl->version != SHM_VERSION || block == 0 || slots == 0
+      || lanes == 0 || offset % page
+      || offset < sizeof *ctl + lanes * sizeof (struct shm_lane)
+      || (uint64_t)st.st_size
+         != offset + (uint64_t)lanes * slots * block * 4
+      || (shm = malloc (sizeof *shm + block * 4)) == RT_NULL)
+  {
+    munmap ((void *)ctl, st.st_size);
+    return RT_NULL;
+  }
+
+  shm->ctl = ctl;
+  shm->size = st.st_size;
+  shm->block = block;
+  shm->slots = slots;
+  shm->lanes = lanes;
+  shm->avail = 0;
+  strcpy (shm->name, name);
+
+  shm->bell = MAP_FAILED;
+  shm_bell_name (bname, sizeof bname, name);
+  fd = shm_open (bname, O_RDWR, 0);
+  if (fd >= 0)
+  {
+    if (fstat (fd, &st) == 0 && (size_t)st.st_size >= sizeof *shm->bell)
+    {
+      shm->bell = mmap (NULL, sizeof *shm->bell, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    }
+
+    close (fd);
+  }
+
+  if (shm->bell == MAP_FAILED || shm_lane_take (shm) < 0)
+  {
+    if (shm->bell != MAP_FAILED)
+    {
+      munmap (shm->bell, sizeof *shm->bell);
+    }
+
+    munmap ((void *)ctl, shm->size);
+    free (shm);
+    return RT_NULL;
+  }
+
+  return shm;
+}
+
+/* Take a block into the cache.  Return 0 when the lane is empty.  */
+static int shm_claim (struct neug_shm *shm)
+{
+  const struct shm_ctl *ctl = shm->ctl;
+  uint64_t pos = shm->ack->tail;
+
+  if (pos == __atomic_load_n (&ctl->lane[shm->lane].head, __ATOMIC_ACQUIRE))
+  {
+    return 0;
+  }
+
+  memcpy (shm->cache, &shm->data[(pos % shm->slots) * shm->block],
+          shm->block * 4);
+  __atomic_store_n (&shm->ack->tail, pos + 1, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n (&ctl->prod_waiting, __ATOMIC_SEQ_CST))
+  {
+    shm_ring (shm->bell);
+  }
+
+  shm->avail = shm->block * 4;
+  return 1;
+}
+
+/* Sleep until a block is published, or until DEADLINE.  */
+static int shm_wait (struct neug_shm *shm, const struct timespec *deadline)
+{
+  const struct shm_lane *lane = &shm->ctl->lane[shm->lane];
+  struct timespec now, ts;
+  uint32_t pub;
+
+  if (deadline)
+  {
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    ts.tv_sec = deadline->tv_sec - now.tv_sec;
+    ts.tv_nsec = deadline->tv_nsec - now.tv_nsec;
+    if (ts.tv_nsec < 0)
+    {
+      ts.tv_sec--;
+      ts.tv_nsec += 1000000000;
+    }
+
+    if (ts.tv_sec < 0)
+    {
+      return -1;
+    }
+  }
+
+  pub = __atomic_load_n (&lane->pub, __ATOMIC_SEQ_CST);
+  __atomic_store_n (&shm->ack->waiting, 1, __ATOMIC_SEQ_CST);
+  if (shm->ack->tail == __atomic_load_n (&lane->head, __ATOMIC_SEQ_CST)
+      && __atomic_load_n (&shm->ctl->alive, __ATOMIC_SEQ_CST))
+  {
+    futex (&lane->pub, FUTEX_WAIT, pub, deadline ? &ts : NULL);
+  }
+
+  __atomic_store_n (&shm->ack->waiting, 0, __ATOMIC_SEQ_CST);
+  return 0;
+}
+
+/**
+ * @brief  Read LEN bytes from the pool.
+ * @detail Whole blocks are taken, and bytes left are kept for next
+ *         read by this process.  It waits TIMEOUT ticks at most, or
+ *         forever with RT_WAITING_FOREVER.  A forked child takes
+ *         a lane of its own.
+ * @return The number of bytes read, which is less than LEN on timeout
+ *         or when the producer has stopped.
+ */
+int neug_shm_read (struct neug_shm *shm, void *buf, int len, int32_t timeout)
+{
+  uint8_t *p = (uint8_t *)buf;
+  struct timespec deadline;
+  int n = 0;
+
+  /* Don't share the cache nor the lane with a forked child.  */
+  if (shm->gen != __atomic_load_n (&shm_fork_gen, __ATOMIC_RELAXED))
+  {
+    memset (shm->cache, 0, shm->block * 4);
+    shm->avail = 0;
+    if (shm->ack)
+    {
+      munmap (shm->ack, sizeof *shm->ack);
+      shm->ack = RT_NULL;
+    }
+
+    if (shm_lane_take (shm) < 0)
+    {
+      return 0;
+    }
+  }
+
+  if (timeout > 0)
+  {
+    clock_gettime (CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout / RT_TICK_PER_SECOND;
+    deadline.tv_nsec += (long)(timeout % RT_TICK_PER_SECOND)
+                        * (1000000000 / RT_TICK_PER_SECOND);
+    if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+
+  while (n < len)
+  {
+    if (shm->avail)
+    {
+      uint8_t *s = shm->cache + shm->block * 4 - shm->avail;
+      int m = len - n < shm->avail ? len - n : shm->avail;
+
+      memcpy (p + n, s, m);
+      memset (s, 0, m);
+      shm->avail -= m;
+      n += m;
+      continue;
+    }
+
+    if (shm_claim (shm))
+    {
+      continue;
+    }
+
+    if (timeout == 0 || !__atomic_load_n (&shm->ctl->alive, __ATOMIC_SEQ_CST)
+        || shm_wait (shm, timeout > 0 ? &deadline : NULL) < 0)
+    {
+      break;
+    }
+  }
+
+  return n;
+}
+
+void neug_shm_close (struct neug_shm *shm)
+{
+  if (shm->ack)
+  {
+    /* The producer removes the lane, a child leaves it to the parent.  */
+    if (shm->gen == shm_fork_gen)
+    {
+      __atomic_store_n (&shm->ack->closed, 1, __ATOMIC_SEQ_CST);
+      shm_ring (shm->bell);
+    }
+
+    munmap (shm->ack, sizeof *shm->ack);
+  }
+
+  munmap (shm->bell, sizeof *shm->bell);
+
+  munmap ((void *)shm->ctl, shm->size);
+  memset (shm->cache, 0, shm->block * 4);
+  free (shm);
+}
+
+#ifdef RT_USING_FINSH
+#include <finsh.h>
+
+static void neug_shm (int argc, char **argv)
+{
+  if (argc > 1 && !strcmp (argv[1], "stop"))
+  {
+    neug_shm_unpublish ();
+  }
+  else if (neug_shm_publish (argc > 1 ? argv[1] : RT_NULL) < 0)
+  {
+    rt_kprintf ("neug_shm: can't publish\n");
+  }
+}
+
+MSH_CMD_EXPORT(neug_shm, publish NeuG output in shared memory: neug_shm [name|stop]);
+#endif
+#endif
@@ -0,0 +1,272 @@
+/*
+ * uniform.c - random integers in a range, and floating point numbers
+ *
+ * This file is a part of NeuG, a True Random Number Generator
+ * implementation based on quantization error of ADC (for STM32F103).
+ *
+ * NeuG is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * NeuG is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#include <stdint.h>
+#include <string.h>
+
+#include <rtthread.h>
+#if defined(__SSE2__)
+#include <x86intrin.h>
+#endif
+
+#include "neug.h"
+
+/*
+ * Integers in [0, BOUND) by the multiply-shift of Lemire: the high
+ * half of X * BOUND is the value, and it's unbiased when the low half
+ * is not less than 2^L mod BOUND (L is the width of X).  Only when the
+ * low half is less than BOUND, the modulo is computed and X may be
+ * rejected, with probability of BOUND / 2^L at most.
+ *
+ * Words are taken from the ring buffer at once for the batch, and a
+ * batch with small BOUND uses 16-bit halves of words, so that the
+ * entropy of the source is not wasted.
+ */
+
+/* Words taken at once for a batch.  Multiple of 5 for doubles.  */
+#define UNIFORM_CHUNK 60
+
+/* BOUND up to this uses 16-bit, rejected 1/256 at most.  */
+#define UNIFORM_SMALL_BOUND 256
+
+/**
+ * @brief  Return a random integer in [0, BOUND), or any 32-bit integer
+ *         when BOUND is 0.
+ */
+uint32_t neug_uniform_u32 (uint32_t bound)
+{
+  uint32_t v = neug_get (NEUG_KICK_FILLING);
+  uint64_t m;
+
+  if (bound == 0)
+  {
+    return v;
+  }
+
+  m = (uint64_t)v * bound;
+
+  if ((uint32_t)m < bound)
+  {
+    uint32_t t = -bound % bound;
+
+    while ((uint32_t)m < t)
+    {
+      m = (uint64_t)neug_get (NEUG_KICK_FILLING) * bound;
+    }
+  }
+
+  return m >> 32;
+}
+
+/* Return the high half of A * B, and the low half in *LO.  */
+static uint64_t mul64 (uint64_t a, uint64_t b, uint64_t *lo)
+{
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 m = (unsigned __int128)a * b;
+
+  *lo = (uint64_t)m;
+  return m >> 64;
+#else
+  uint64_t a0 = (uint32_t)a, a1 = a >> 32;
+  uint64_t b0 = (uint32_t)b, b1 = b >> 32;
+  uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+  uint64_t mid = (p00 >> 32) + (uint32_t)p01 + (uint32_t)p10;
+
+  *lo = (mid << 32) | (uint32_t)p00;
+  return p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+#endif
+}
+
+static uint64_t uniform_word64 (void)
+{
+  uint32_t w[2];
+
+  neug_get_words (w, 2);
+  return w[0] | ((uint64_t)w[1] << 32);
+}
+
+/**
+ * @brief  Return a random integer in [0, BOUND), or any 64-bit integer
+ *         when BOUND is 0.  A single word is used when BOUND fits.
+ */
+uint64_t neug_uniform_u64 (uint64_t bound)
+{
+  uint64_t hi, lo;
+
+  if (bound == 0)
+  {
+    return uniform_word64 ();
+  }
+
+  if (bound <= 0x100000000ULL)
+  {
+    return neug_uniform_u32 ((uint32_t)bound);
+  }
+
+  hi = mul64 (uniform_word64 (), bound, &lo);
+  if (lo < bound)
+  {
+    uint64_t t = -bound % bound;
+
+    while (lo < t)
+    {
+      hi = mul64 (uniform_word64 (), bound, &lo);
+    }
+  }
+
+  return hi;
+}
+
+/*
+ * Map 32-bit words of A into [0, BOUND), in place.  Rejected one is
+ * replaced by a new draw.
+ */
+static void uniform_map32 (uint32_t *a, int n, uint32_t bound)
+{
+  uint32_t t = -bound % bound;
+  int i = 0;
+
+#if defined(__SSE2__)
+  const __m128i b = _mm_set1_epi32 (bound);
+  const __m128i sign = _mm_set1_epi32 (0x80000000);
+  const __m128i ts = _mm_xor_si128 (_mm_set1_epi32 (t), sign);
+
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i x = _mm_loadu_si128 ((const __m128i *)&a[i]);
+    /* Products of lane 0, 2 and of lane 1, 3.  */
+    __m128i even = _mm_mul_epu32 (x, b);
+    __m128i odd = _mm_mul_epu32 (_mm_srli_epi64 (x, 32), b);
+    __m128i hi = _mm_unpacklo_epi32 (_mm_shuffle_epi32 (even, 0x0d),
+                                     _mm_shuffle_epi32 (odd, 0x0d));
+    __m128i lo = _mm_unpacklo_epi32 (_mm_shuffle_epi32 (even, 0x08),
+                                     _mm_shuffle_epi32 (odd, 0x08));
+    /* Unsigned LO < T, by signed compare.  */
+    int reject = _mm_movemask_ps (_mm_castsi128_ps (
+                   _mm_cmpgt_epi32 (ts, _mm_xor_si128 (lo, sign))));
+
+    _mm_storeu_si128 ((__m128i *)&a[i], hi);
+    while (reject)
+    {
+      int j = __builtin_ctz (reject);
+
+      a[i + j] = neug_uniform_u32 (bound);
+      reject &= reject - 1;
+    }
+  }
+#endif
+
+  for (; i < n; i++)
+  {
+    uint64_t m = (uint64_t)a[i] * bound;
+
+    a[i] = (uint32_t)m >= t ? (uint32_t)(m >> 32) : neug_uniform_u32 (bound);
+  }
+}
+
+/*
+ * Fill A with integers in [0, BOUND) from 16-bit halves of words.
+ */
+static void uniform_fill16 (uint32_t *a, int n, uint32_t bound)
+{
+  uint32_t w[UNIFORM_CHUNK];
+  uint32_t t = 0x10000 % bound;
+  int i = 0, h = 0;		/* Next half, and halves in W */
+
+  while (n > 0)
+  {
+    uint32_t m;
+
+    if (i == h)
+    {
+      int k = (n + 1) / 2 < UNIFORM_CHUNK ? (n + 1) / 2 : UNIFORM_CHUNK;
+
+      neug_get_words (w, k);
+      h = k * 2;
+      i = 0;
+    }
+
+    m = ((w[i / 2] >> (i % 2 * 16)) & 0xffff) * bound;
+    i++;
+    if ((m & 0xffff) >= t)
+    {
+      *a++ = m >> 16;
+      n--;
+    }
+  }
+
+  memset (w, 0, sizeof w);
+}
+
+/**
+ * @brief  Fill A with N random integers in [0, BOUND), or any 32-bit
+ *         integers when BOUND is 0.
+ */
+void neug_fill_uniform (uint32_t *a, int n, uint32_t bound)
+{
+  if (bound != 0 && bound <= UNIFORM_SMALL_BOUND)
+  {
+    uniform_fill16 (a, n, bound);
+    return;
+  }
+
+  neug_get_words (a, n);
+  if (bound != 0)
+  {
+    uniform_map32 (a, n, bound);
+  }
+}
+
+/* 53-bit integer to [0, 1).  */
+#define UNIFORM_DOUBLE(x) ((double)(x) * (1.0 / 9007199254740992.0))
+
+/**
+ * @brief  Fill A with N random numbers in [0, 1), of 53-bit.
+ * @detail Three numbers are made from five words (159-bit).
+ */
+void neug_fill_double (double *a, int n)
+{
+  uint32_t w[UNIFORM_CHUNK];
+
+  while (n >= 3)
+  {
+    int m = n / 3 < UNIFORM_CHUNK / 5 ? n / 3 : UNIFORM_CHUNK / 5;
+    const uint32_t *p = w;
+
+    neug_get_words (w, m * 5);
+    n -= m * 3;
+    while (m--)
+    {
+      *a++ = UNIFORM_DOUBLE (p[0] | ((uint64_t)(p[1] & 0x1fffff) << 32));
+      *a++ = UNIFORM_DOUBLE ((p[1] >> 21) | ((uint64_t)p[2] << 11)
+                             | ((uint64_t)(p[3] & 0x3ff) << 43));
+      *a++ = UNIFORM_DOUBLE ((p[3] >> 10)
+                             | ((uint64_t)(p[4] & 0x7fffffff) << 22));
+      p += 5;
+    }
+  }
+
+  while (n-- > 0)
+  {
+    *a++ = UNIFORM_DOUBLE (uniform_word64 () >> 11);
+  }
+
+  memset (w, 0, sizeof w);
+}